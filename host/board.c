@@ -0,0 +1,113 @@
+/**
+    Simulated clock board.
+
+    Models the shift register chain driven from port A, so the host harness
+    can see what the display is actually showing.
+*/
+
+#include <math.h>
+
+#include "board.h"
+#include "../src/io.h"
+#include "../src/light.h"
+#include "../src/temperature.h"
+
+
+ShiftWord boardLatchedWord = 0;
+uint32_t boardLatchCount = 0;
+uint64_t boardLastLitCycle = 0;
+
+uint16_t boardLightLevel = 0;
+uint16_t boardLightNoise = 0;
+double boardTemperature = 25;
+
+static ShiftWord shiftStage = 0;
+static uint8_t previousPins = 0;
+static uint32_t noiseSeed = 1;
+
+
+void boardPinsChanged(uint8_t pins)
+{
+    uint8_t risingPins = pins & ~previousPins;
+    previousPins = pins;
+
+    // The clear input is active low.
+    if ( ! (pins & IO_PIN_SHIFT_CLEAR))
+    {
+        shiftStage = 0;
+    }
+
+    if (risingPins & IO_PIN_SHIFT_CLOCK)
+    {
+        shiftStage = ((shiftStage << 1) | ((pins & IO_PIN_SHIFT_DATA) ? 1 : 0)) & BOARD_CHAIN_MASK;
+    }
+
+    if (risingPins & IO_PIN_SHIFT_LATCH)
+    {
+        boardLatchedWord = shiftStage;
+        boardLatchCount++;
+        if (isBoardLit())
+        {
+            boardLastLitCycle = hostCycles;
+        }
+    }
+}
+
+
+/**
+    Get a random noise value.
+
+    @param amplitude    The largest noise, either way.
+*/
+static int32_t getNoise(uint16_t amplitude)
+{
+    // A fixed seed keeps runs repeatable.
+    noiseSeed = noiseSeed * 1103515245 + 12345;
+    return (int32_t) ((noiseSeed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+
+uint16_t boardReadAdc(uint8_t channel)
+{
+    int32_t level;
+    if (channel == LIGHT_ADC_CHANNEL)
+    {
+        level = (int32_t) boardLightLevel + getNoise(boardLightNoise);
+    }
+    else if (channel == (TEMPERATURE_ADC_MUX & 0x3f))
+    {
+        // Noise of up to a count, before rounding, dithers the reading.
+        level = (int32_t) floor(TEMPERATURE_ADC_OFFSET + boardTemperature + getNoise(8) / 8.0 + 0.5);
+    }
+    else
+    {
+        return 0;
+    }
+
+    return (level < 0) ? 0 : (level > LIGHT_ADC_MAX) ? LIGHT_ADC_MAX : level;
+}
+
+
+bool isBoardLit()
+{
+    return isBoardWordLit(boardLatchedWord);
+}
+
+
+bool isBoardWordLit(ShiftWord word)
+{
+    // Segment outputs are active low.
+    return (~word & BOARD_SEGMENT_MASK) != 0;
+}
+
+
+uint8_t getBoardWordDigit(ShiftWord word)
+{
+    // Digit select lines are inverted digit number bits. A 4 digit board
+    // has no third select line.
+    uint8_t digit = ((word & 0x0001) ? 0 : 1) | ((word & 0x8000) ? 0 : 2);
+#if DISPLAY_DIGITS > 4
+    digit |= (word & 0x10000) ? 0 : 4;
+#endif
+    return digit;
+}
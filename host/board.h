@@ -0,0 +1,74 @@
+/**
+    Simulated clock board.
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "hal_host.h"
+#include "../src/io.h"
+
+
+/**
+    Shift register outputs wired to display segments.
+    Bits 0, 15 and 16 are the digit select lines, see display.c.
+*/
+#define BOARD_SEGMENT_MASK  0x7ffe
+
+/**
+    Shift register outputs on the chain.
+*/
+#define BOARD_CHAIN_MASK    ((ShiftWord) ((1ULL << IO_SHIFT_BITS) - 1))
+
+
+/**
+    The word most recently latched onto the shift register outputs.
+*/
+extern ShiftWord boardLatchedWord;
+
+
+/**
+    The number of times the shift register outputs have been latched.
+*/
+extern uint32_t boardLatchCount;
+
+
+/**
+    The cycle at which a lit segment was last latched.
+*/
+extern uint64_t boardLastLitCycle;
+
+
+/**
+    Light falling on the light sensor, as the ADC counts it reads, and the
+    amplitude of the noise on each reading.
+*/
+extern uint16_t boardLightLevel;
+extern uint16_t boardLightNoise;
+
+
+/**
+    Temperature of the chip, in degrees C. The temperature sensor reads it
+    as TEMPERATURE_ADC_OFFSET counts at 0 C, with up to a count of noise.
+*/
+extern double boardTemperature;
+
+
+/**
+    Check if any segment is currently lit.
+*/
+bool isBoardLit();
+
+
+/**
+    Check if a latched word lights any segment.
+*/
+bool isBoardWordLit(ShiftWord word);
+
+
+/**
+    Get the digit selected by a latched word.
+*/
+uint8_t getBoardWordDigit(ShiftWord word);
+
+#endif
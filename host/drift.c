@@ -0,0 +1,299 @@
+/**
+    Oscillator temperature drift simulator.
+
+    The simulated chip counts oscillator cycles, so real time is worked out
+    alongside: each cycle lasts 1 / F_CPU seconds, stretched or shortened
+    by the oscillator's error at the board's temperature, which follows a
+    trace of temperatures through the run. The temperature sensor reads
+    the same temperature, so the firmware can correct for it.
+
+    The trace is run twice, first with a flat temperature curve in EEPROM,
+    then with the curve fitted to the oscillator, and the clock is compared
+    with real time at the end of each run.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "drift.h"
+#include "board.h"
+#include "firmware.h"
+#include "../src/clock.h"
+#include "../src/temperature.h"
+
+
+#define SECONDS_PER_HOUR        3600
+#define SECONDS_PER_DAY         86400UL
+
+// Run the firmware this long between temperature changes.
+#define DRIFT_STEP_CYCLES       (F_CPU / 100)
+
+// Run the firmware this long at the starting temperature before each run,
+// so the temperature filter and the correction settle.
+#define DRIFT_SETTLE_SECONDS    10
+
+// Step size when waiting for the clock to start a second, which sets the
+// resolution of the time error.
+#define DRIFT_SECOND_STEP_CYCLES    64
+
+// The simulated oscillator's curve, a parabola about a turnover temperature,
+// as for a typical crystal.
+#define DRIFT_TURNOVER          25
+#define DRIFT_LINEAR_PPM        0.25
+#define DRIFT_QUADRATIC_PPM     -0.034
+
+// Largest allowed mean error of the compensated clock, in parts per
+// million.
+#define DRIFT_LIMIT_PPM         1.0
+
+
+/**
+    Default trace, in the same format as trace files. Each line is the time
+    in hours and the temperature in degrees C, which changes linearly
+    between lines.
+*/
+static const char* defaultTrace[] = {
+    "0       20",
+    "1       20",
+    "2       40",
+    "3       40",
+    "4       5",
+    "5       5",
+    "6       20",
+};
+
+
+typedef struct
+{
+    double seconds;
+    double celsius;
+} TracePoint;
+
+#define MAX_TRACE_POINTS    256
+
+static TracePoint trace[MAX_TRACE_POINTS];
+static size_t traceLength = 0;
+
+
+static bool parseTraceLine(const char* line)
+{
+    double hours;
+    double celsius;
+
+    if (line[0] == '#' || sscanf(line, "%lf %lf", &hours, &celsius) != 2)
+    {
+        return true;
+    }
+
+    if (traceLength >= MAX_TRACE_POINTS)
+    {
+        fprintf(stderr, "too many trace points\n");
+        return false;
+    }
+
+    if (traceLength > 0 && hours * SECONDS_PER_HOUR <= trace[traceLength - 1].seconds)
+    {
+        fprintf(stderr, "trace points must be in time order\n");
+        return false;
+    }
+
+    if (celsius < -40 || celsius > 85)
+    {
+        fprintf(stderr, "trace temperatures must be from -40 to 85 C\n");
+        return false;
+    }
+
+    trace[traceLength].seconds = hours * SECONDS_PER_HOUR;
+    trace[traceLength].celsius = celsius;
+    traceLength++;
+    return true;
+}
+
+
+static bool loadTrace(const char* path)
+{
+    if (path == NULL)
+    {
+        for (size_t i = 0; i < sizeof(defaultTrace) / sizeof(defaultTrace[0]); ++i)
+        {
+            if ( ! parseTraceLine(defaultTrace[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[128];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        ok = parseTraceLine(line);
+    }
+
+    fclose(file);
+    return ok && traceLength >= 2;
+}
+
+
+/**
+    Get the trace temperature at a time, in degrees C.
+*/
+static double getTraceCelsius(double seconds)
+{
+    size_t i = 1;
+    while (i < traceLength - 1 && seconds >= trace[i].seconds)
+    {
+        i++;
+    }
+
+    const TracePoint* a = &trace[i - 1];
+    const TracePoint* b = &trace[i];
+    double fraction = (seconds - a->seconds) / (b->seconds - a->seconds);
+    fraction = (fraction < 0) ? 0 : (fraction > 1) ? 1 : fraction;
+    return a->celsius + (b->celsius - a->celsius) * fraction;
+}
+
+
+/**
+    Get the simulated oscillator's error, in parts per million.
+*/
+static double getOscillatorError(double celsius)
+{
+    double difference = celsius - DRIFT_TURNOVER;
+    return DRIFT_LINEAR_PPM * difference + DRIFT_QUADRATIC_PPM * difference * difference;
+}
+
+
+/**
+    Real time, in seconds, since the start of a run.
+*/
+static double realSeconds;
+
+
+/**
+    Run the firmware, and count the real time that passes at the board's
+    temperature.
+*/
+static void runDrift(uint64_t cycles)
+{
+    double cycleSeconds = 1 / (F_CPU * (1 + getOscillatorError(boardTemperature) / 1e6));
+    uint64_t startCycle = hostCycles;
+    runFirmwareUntil(startCycle + cycles);
+    realSeconds += (hostCycles - startCycle) * cycleSeconds;
+}
+
+
+/**
+    Get the clock time, in seconds since midnight.
+*/
+static uint32_t getClockTime()
+{
+    uint32_t snapshot = getClockSnapshot();
+    return BCD_TO_BINARY(CLOCK_SNAPSHOT_HOURS_BCD(snapshot)) * 3600UL
+        + BCD_TO_BINARY(CLOCK_SNAPSHOT_MINUTES_BCD(snapshot)) * 60UL
+        + BCD_TO_BINARY(CLOCK_SNAPSHOT_SECONDS_BCD(snapshot));
+}
+
+
+/**
+    Run the firmware until the clock starts its next second.
+*/
+static void runUntilNextSecond()
+{
+    uint32_t time = getClockTime();
+    while (getClockTime() == time)
+    {
+        runDrift(DRIFT_SECOND_STEP_CYCLES);
+    }
+}
+
+
+/**
+    Run the trace once.
+
+    @return     The time the clock gained by the end, in seconds.
+*/
+static double runTraceOnce(const char* name, int8_t turnover, int8_t linear, int8_t quadratic)
+{
+    setTemperatureCurve(turnover, linear, quadratic);
+
+    boardTemperature = trace[0].celsius;
+    runFirmwareUntil(hostCycles + DRIFT_SETTLE_SECONDS * F_CPU);
+    runUntilNextSecond();
+
+    realSeconds = 0;
+    uint32_t startTime = getClockTime();
+    uint32_t previousTime = startTime;
+    uint64_t clockSeconds = 0;
+    double endSeconds = trace[traceLength - 1].seconds;
+
+    while (realSeconds < endSeconds)
+    {
+        boardTemperature = getTraceCelsius(realSeconds);
+        runDrift(DRIFT_STEP_CYCLES);
+
+        // Count whole days as the clock passes midnight.
+        uint32_t time = getClockTime();
+        if (time < previousTime)
+        {
+            clockSeconds += SECONDS_PER_DAY;
+        }
+        previousTime = time;
+    }
+
+    runUntilNextSecond();
+    clockSeconds += getClockTime();
+    if (getClockTime() < previousTime)
+    {
+        clockSeconds += SECONDS_PER_DAY;
+    }
+    clockSeconds -= startTime;
+
+    double error = clockSeconds - realSeconds;
+    printf("%-16s curve %+03d %+03d %+03d   error %+9.1f ms   %+7.2f ppm\n",
+        name, turnover, linear, quadratic, error * 1e3, error / realSeconds * 1e6);
+    return error;
+}
+
+
+int runDriftCheck(int argc, char** argv)
+{
+    const char* tracePath = (argc > 0) ? argv[0] : NULL;
+    if ( ! loadTrace(tracePath))
+    {
+        fprintf(stderr, "usage: drift [trace]\n");
+        return 1;
+    }
+
+    double minimum = trace[0].celsius;
+    double maximum = trace[0].celsius;
+    for (size_t i = 1; i < traceLength; ++i)
+    {
+        minimum = fmin(minimum, trace[i].celsius);
+        maximum = fmax(maximum, trace[i].celsius);
+    }
+    double seconds = trace[traceLength - 1].seconds;
+    printf("trace            %.1f hours, %.1f to %.1f C\n", seconds / SECONDS_PER_HOUR, minimum, maximum);
+    printf("oscillator       %+.3f ppm/C %+.4f ppm/C^2 about %d C\n",
+        DRIFT_LINEAR_PPM, DRIFT_QUADRATIC_PPM, DRIFT_TURNOVER);
+
+    // The fitted curve, in the units setTemperatureCurve() takes.
+    int8_t linear = (int8_t) lround(DRIFT_LINEAR_PPM * 16);
+    int8_t quadratic = (int8_t) lround(DRIFT_QUADRATIC_PPM * 256);
+
+    runTraceOnce("uncompensated", 0, 0, 0);
+    double error = runTraceOnce("compensated", DRIFT_TURNOVER, linear, quadratic);
+
+    bool isPassing = fabs(error / seconds * 1e6) < DRIFT_LIMIT_PPM;
+    printf("%s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+/**
+    Oscillator temperature drift simulator.
+*/
+
+#ifndef DRIFT_H
+#define DRIFT_H
+
+
+/**
+    Run the firmware against an oscillator that drifts with temperature,
+    through a temperature trace, and report the time the clock gains or
+    loses with and without temperature compensation.
+
+    @param argc     Number of arguments.
+    @param argv     Optional trace file of "<hours> <celsius>" lines.
+    @return         Zero if the compensated clock kept time.
+*/
+int runDriftCheck(int argc, char** argv);
+
+#endif
@@ -0,0 +1,564 @@
+/**
+    Faster-than-real-time firmware emulator.
+
+    Drives the firmware's timer interrupt handlers from the simulated
+    timers in hal_host.c, jumping straight from one compare match to the
+    next, and replays a script of speed button presses and mode switch
+    flips. The clock is checked to count one second each time the second
+    phase wraps, and to move forward only in time set steps while the
+    button is held. The blink phase is checked too.
+
+    The clock is counted from the system tick, so every tick is emulated,
+    and long runs are limited by the rate of display refreshes. Simulating
+    the shift register pins for each refresh costs more than the rest of
+    the firmware put together, so the display is only watched while it
+    blinks, for a minute after each script event, and for the first second
+    of each minute after that. The rest of the run only counts the
+    refreshes' cycles.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "emulator.h"
+#include "board.h"
+#include "firmware.h"
+#include "../src/io.h"
+#include "../src/clock.h"
+#include "../src/display.h"
+#include "../src/backup.h"
+#include "../src/tick.h"
+
+
+#define DEFAULT_DAYS                4
+
+#define SECONDS_PER_DAY             86400UL
+
+// The last phase of a second, counted in units of 2^CLOCK_PHASE_SHIFT ticks.
+#define CLOCK_PHASE_MAX             ((TICK_RATE_HZ - 1) >> CLOCK_PHASE_SHIFT)
+#define CYCLES_PER_MS               (F_CPU / 1000)
+
+// The first time set step must follow a press once it has been debounced,
+// and steps must stop once a release has been.
+#define FIRST_STEP_LIMIT_CYCLES     (50 * CYCLES_PER_MS)
+#define LAST_STEP_LIMIT_CYCLES      (50 * CYCLES_PER_MS)
+
+// Holding the button this long must reach any time of day.
+#define FULL_DAY_SET_CYCLES         (7000 * CYCLES_PER_MS)
+#define MINUTES_PER_DAY             (24 * 60)
+
+// Longest gap between lit refreshes that isn't a blink.
+#define MULTIPLEX_GAP_LIMIT_CYCLES  (20 * CYCLES_PER_MS)
+
+// Allowed length of the dark half of a blink.
+#define BLINK_GAP_MIN_CYCLES        (490 * CYCLES_PER_MS)
+#define BLINK_GAP_MAX_CYCLES        (515 * CYCLES_PER_MS)
+
+// Watch the display for this long after each script event, and for the
+// first second of each minute.
+#define DISPLAY_WATCH_CYCLES        (60000 * CYCLES_PER_MS)
+#define DISPLAY_SAMPLE_PERIOD       (60000 * CYCLES_PER_MS)
+#define DISPLAY_SAMPLE_CYCLES       (1000 * CYCLES_PER_MS)
+
+
+typedef enum
+{
+    ACTION_PRESS,
+    ACTION_RELEASE,
+    ACTION_ELEMENTS,
+    ACTION_DIGITS,
+} Action;
+
+typedef struct
+{
+    double seconds;
+    Action action;
+} ScriptEvent;
+
+
+/**
+    Default script, in the same format as script files.
+    Each line is the simulated time in seconds and an action.
+*/
+static const char* defaultScript[] = {
+    "10      press",
+    "40      release",
+    "45      press",
+    "45.06   release",
+    "50      press",
+    "50.1    release",
+    "60      elements",
+    "70      digits",
+    "70.8    elements",
+    "80      digits",
+    "86400   press",
+    "86700   release",
+    "172800  elements",
+    "259200  digits",
+};
+
+
+#define MAX_SCRIPT_EVENTS   256
+
+static ScriptEvent script[MAX_SCRIPT_EVENTS];
+static size_t scriptLength = 0;
+
+
+static bool parseScriptLine(const char* line)
+{
+    char actionName[16];
+    double seconds;
+
+    if (line[0] == '#' || sscanf(line, "%lf %15s", &seconds, actionName) != 2)
+    {
+        return true;
+    }
+
+    if (scriptLength >= MAX_SCRIPT_EVENTS)
+    {
+        fprintf(stderr, "too many script events\n");
+        return false;
+    }
+
+    ScriptEvent* event = &script[scriptLength];
+    event->seconds = seconds;
+    if (strcmp(actionName, "press") == 0)
+    {
+        event->action = ACTION_PRESS;
+    }
+    else if (strcmp(actionName, "release") == 0)
+    {
+        event->action = ACTION_RELEASE;
+    }
+    else if (strcmp(actionName, "elements") == 0)
+    {
+        event->action = ACTION_ELEMENTS;
+    }
+    else if (strcmp(actionName, "digits") == 0)
+    {
+        event->action = ACTION_DIGITS;
+    }
+    else
+    {
+        fprintf(stderr, "unknown script action '%s'\n", actionName);
+        return false;
+    }
+
+    if (scriptLength > 0 && seconds < script[scriptLength - 1].seconds)
+    {
+        fprintf(stderr, "script events must be in time order\n");
+        return false;
+    }
+
+    scriptLength++;
+    return true;
+}
+
+
+static bool loadScript(const char* path)
+{
+    if (path == NULL)
+    {
+        for (size_t i = 0; i < sizeof(defaultScript) / sizeof(defaultScript[0]); ++i)
+        {
+            if ( ! parseScriptLine(defaultScript[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[128];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        ok = parseScriptLine(line);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+
+/**
+    Emulation state and check results.
+*/
+static uint64_t countedSeconds = 0;
+static uint64_t rollovers = 0;
+static uint64_t interrupts = 0;
+static uint64_t failures = 0;
+
+static bool isBlinkExpected = true;
+static uint64_t blinkGaps = 0;
+static uint64_t blinkStartCycle = 0;
+static uint64_t blinkEndCycle = 0;
+static uint64_t previousLitCycle = 0;
+static uint64_t watchEndCycle = 0;
+
+static uint32_t previousTime = 0;
+static uint8_t previousPhase = 0;
+static uint64_t timeSetSteps = 0;
+
+static bool isPressed = false;
+static bool isWaitingForFirstStep = false;
+static uint64_t pressCycle = 0;
+static uint64_t releaseCycle = 0;
+static uint32_t secondsSetSincePress = 0;
+static bool isFullDayChecked = false;
+
+
+static void fail(const char* message, double value)
+{
+    if (failures < 10)
+    {
+        fprintf(stderr, "FAIL at %.3f s: %s (%.3f)\n",
+            (double) hostCycles / F_CPU, message, value);
+    }
+    failures++;
+}
+
+
+static void applyAction(Action action)
+{
+    switch (action)
+    {
+        case ACTION_PRESS:
+            hostDriveInputs(IO_PIN_SPEED_BUTTON, false);
+            break;
+
+        case ACTION_RELEASE:
+            hostDriveInputs(IO_PIN_SPEED_BUTTON, true);
+            break;
+
+        case ACTION_ELEMENTS:
+            hostDriveInputs(IO_PIN_ELEMENT_MODE_SWITCH, false);
+            break;
+
+        case ACTION_DIGITS:
+            hostDriveInputs(IO_PIN_ELEMENT_MODE_SWITCH, true);
+            break;
+    }
+
+    runFirmwareMainLoop();
+    watchEndCycle = hostCycles + DISPLAY_WATCH_CYCLES;
+
+    if (action == ACTION_RELEASE)
+    {
+        isPressed = false;
+        releaseCycle = hostCycles;
+    }
+
+    if (action == ACTION_PRESS)
+    {
+        isPressed = true;
+        isWaitingForFirstStep = true;
+        isFullDayChecked = false;
+        pressCycle = hostCycles;
+        secondsSetSincePress = 0;
+    }
+}
+
+
+static uint32_t getClockTime()
+{
+    uint32_t snapshot = getClockSnapshot();
+    return BCD_TO_BINARY(CLOCK_SNAPSHOT_HOURS_BCD(snapshot)) * 3600UL
+        + BCD_TO_BINARY(CLOCK_SNAPSHOT_MINUTES_BCD(snapshot)) * 60UL
+        + BCD_TO_BINARY(CLOCK_SNAPSHOT_SECONDS_BCD(snapshot));
+}
+
+
+/**
+    Check a second counted by the clock.
+*/
+static void checkClockSecond(uint32_t actual, uint8_t phase)
+{
+    countedSeconds++;
+
+    if (phase != 0)
+    {
+        fail("second did not start at the tick", phase);
+    }
+
+    if (actual == 0)
+    {
+        rollovers++;
+    }
+}
+
+
+/**
+    Check a change made to the clock by the time set handler.
+*/
+static void checkTimeSet(uint32_t advance)
+{
+    timeSetSteps++;
+    secondsSetSincePress += advance;
+
+    if (CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot()) != 0 || advance > 3600)
+    {
+        fail("time set step is not a whole step forward (s)", advance);
+    }
+
+    if ( ! isPressed && hostCycles - releaseCycle > LAST_STEP_LIMIT_CYCLES)
+    {
+        fail("time set step after release (ms)", (double) (hostCycles - releaseCycle) / CYCLES_PER_MS);
+    }
+
+    if (isWaitingForFirstStep)
+    {
+        isWaitingForFirstStep = false;
+        uint64_t latency = hostCycles - pressCycle;
+        if (latency > FIRST_STEP_LIMIT_CYCLES)
+        {
+            fail("first time set step late (ms)", (double) latency / CYCLES_PER_MS);
+        }
+    }
+
+    // Setting the time stops the blinking.
+    if (isBlinkExpected)
+    {
+        isBlinkExpected = false;
+        blinkEndCycle = hostCycles;
+    }
+
+    if (isPressed && ! isFullDayChecked && hostCycles - pressCycle >= FULL_DAY_SET_CYCLES)
+    {
+        isFullDayChecked = true;
+        if (secondsSetSincePress < (MINUTES_PER_DAY - 1) * 60)
+        {
+            fail("holding the button is too slow to set the time (minutes)", secondsSetSincePress / 60);
+        }
+    }
+}
+
+
+/**
+    Check the clock after a system tick.
+
+    The time only changes by counting one second as the phase wraps, or by
+    a time set step.
+*/
+static void checkTick()
+{
+    uint8_t phase = CLOCK_SNAPSHOT_PHASE(getClockSnapshot());
+    uint32_t actual = getClockTime();
+    uint32_t advance = (actual + SECONDS_PER_DAY - previousTime) % SECONDS_PER_DAY;
+
+    if (phase > CLOCK_PHASE_MAX)
+    {
+        fail("second phase out of range", phase);
+    }
+
+    if (advance == 0)
+    {
+        if (phase < previousPhase)
+        {
+            fail("second ended without counting", actual);
+        }
+    }
+    else if (advance == 1 && previousPhase == CLOCK_PHASE_MAX)
+    {
+        checkClockSecond(actual, phase);
+    }
+    else
+    {
+        checkTimeSet(advance);
+    }
+
+    previousTime = actual;
+    previousPhase = phase;
+}
+
+
+static void checkDisplayRefresh()
+{
+    if (boardLastLitCycle == previousLitCycle)
+    {
+        return;
+    }
+
+    uint64_t gapStart = previousLitCycle;
+    uint64_t gap = boardLastLitCycle - previousLitCycle;
+    previousLitCycle = boardLastLitCycle;
+
+    if (gap <= MULTIPLEX_GAP_LIMIT_CYCLES)
+    {
+        return;
+    }
+
+    if (gapStart >= blinkEndCycle)
+    {
+        fail("display dark while not blinking (ms)", (double) gap / CYCLES_PER_MS);
+    }
+    else if (boardLastLitCycle > blinkEndCycle)
+    {
+        // A dark phase cut short when blinking stopped.
+        if (gap > BLINK_GAP_MAX_CYCLES)
+        {
+            fail("blink dark phase too long (ms)", (double) gap / CYCLES_PER_MS);
+        }
+    }
+    else if (gap < BLINK_GAP_MIN_CYCLES || gap > BLINK_GAP_MAX_CYCLES)
+    {
+        fail("blink dark phase wrong length (ms)", (double) gap / CYCLES_PER_MS);
+    }
+    else
+    {
+        blinkGaps++;
+    }
+}
+
+
+/**
+    Watch the display's pins only when checking its refreshes, since
+    simulating them takes most of the emulator's time.
+*/
+static void updateDisplayWatch(uint64_t startCycle)
+{
+    bool isWatched = isBlinkExpected || hostCycles < watchEndCycle ||
+        (hostCycles - startCycle) % DISPLAY_SAMPLE_PERIOD < DISPLAY_SAMPLE_CYCLES;
+
+    // The refreshes weren't seen while unwatched, so the gap so far isn't
+    // checked. The first latch may show a digit shifted out unwatched.
+    if (isWatched && ! hostArePinsObserved)
+    {
+        previousLitCycle = boardLastLitCycle = hostCycles;
+    }
+    hostArePinsObserved = isWatched;
+}
+
+
+static double getWallTimeSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+int runEmulator(int argc, char** argv)
+{
+    double days = (argc > 0) ? atof(argv[0]) : DEFAULT_DAYS;
+    const char* scriptPath = (argc > 1) ? argv[1] : NULL;
+
+    if (days <= 0 || ! loadScript(scriptPath))
+    {
+        fprintf(stderr, "usage: emulate [days] [script]\n");
+        return 1;
+    }
+
+    uint64_t startCycle = hostCycles;
+    uint64_t endCycle = startCycle + (uint64_t) (days * SECONDS_PER_DAY * F_CPU);
+    size_t nextEvent = 0;
+
+    blinkStartCycle = startCycle;
+    blinkEndCycle = endCycle;
+    previousLitCycle = boardLastLitCycle = startCycle;
+    watchEndCycle = startCycle + DISPLAY_WATCH_CYCLES;
+
+    // The firmware blinks the display at power up.
+    setDisplayBlink(true);
+
+    double wallStart = getWallTimeSeconds();
+    runFirmwareMainLoop();
+
+    while (hostCycles < endCycle)
+    {
+        uint64_t limit = endCycle;
+        if (nextEvent < scriptLength)
+        {
+            uint64_t eventCycle = startCycle + (uint64_t) (script[nextEvent].seconds * F_CPU);
+            limit = (eventCycle < limit) ? eventCycle : limit;
+        }
+
+        updateDisplayWatch(startCycle);
+        HostInterrupt interrupt = hostRunUntilInterrupt(limit);
+        switch (interrupt)
+        {
+            case HOST_INTERRUPT_TIM1_COMPA:
+                checkTick();
+                checkDisplayRefresh();
+                break;
+
+            case HOST_INTERRUPT_TIM1_COMPB:
+                checkDisplayRefresh();
+                break;
+
+            case HOST_INTERRUPT_PCINT1:
+            case HOST_INTERRUPT_TIM0_COMPA:
+            case HOST_INTERRUPT_ADC:
+                break;
+
+            case HOST_INTERRUPT_NONE:
+                while (nextEvent < scriptLength && hostCycles >= startCycle + (uint64_t) (script[nextEvent].seconds * F_CPU))
+                {
+                    Action action = script[nextEvent].action;
+                    nextEvent++;
+
+                    applyAction(action);
+                }
+                continue;
+        }
+
+        interrupts++;
+        runFirmwareMainLoop();
+    }
+
+    hostArePinsObserved = true;
+
+    double wallSeconds = getWallTimeSeconds() - wallStart;
+    double simulatedSeconds = (double) (hostCycles - startCycle) / F_CPU;
+
+    double blinkSeconds = (double) (blinkEndCycle - blinkStartCycle) / F_CPU;
+    if (blinkGaps + 1 < (uint64_t) blinkSeconds)
+    {
+        fail("too few blinks", blinkGaps);
+    }
+
+    // The saved time should be the current minute, as if the power failed
+    // now, unless the button is still held. The backup task checks four times
+    // a second, so the previous minute may still be saved for the first second.
+    uint16_t minuteOfDay = getClockHours() * 60 + getClockMinutes();
+    uint16_t previousMinuteOfDay = (minuteOfDay + MINUTES_PER_DAY - 1) % MINUTES_PER_DAY;
+    bool isNewMinute = CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot()) == 0;
+    if ( ! restoreClockTime())
+    {
+        fail("no saved time", 0);
+    }
+    else
+    {
+        uint16_t savedMinuteOfDay = getClockHours() * 60 + getClockMinutes();
+        if ( ! isSpeedButtonPressed() && savedMinuteOfDay != minuteOfDay &&
+            ! (isNewMinute && savedMinuteOfDay == previousMinuteOfDay))
+        {
+            fail("saved time is not the current minute", savedMinuteOfDay);
+        }
+    }
+
+    printf("simulated time     %12.0f s (%.1f days)\n", simulatedSeconds, simulatedSeconds / SECONDS_PER_DAY);
+    printf("seconds counted    %12llu\n", (unsigned long long) countedSeconds);
+    printf("interrupts         %12llu\n", (unsigned long long) interrupts);
+    printf("midnight rollovers %12llu\n", (unsigned long long) rollovers);
+    printf("blinks             %12llu\n", (unsigned long long) blinkGaps);
+    printf("time set steps     %12llu\n", (unsigned long long) timeSetSteps);
+    printf("eeprom writes/day  %12.0f\n", hostEepromWrites / (simulatedSeconds / SECONDS_PER_DAY));
+    printf("wall time          %12.3f s\n", wallSeconds);
+    printf("interrupts/s       %12.0f\n", interrupts / wallSeconds);
+    printf("speedup            %12.0fx\n", simulatedSeconds / wallSeconds);
+    printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+/**
+    Faster-than-real-time firmware emulator.
+*/
+
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+
+/**
+    Run the emulator.
+
+    @param argc     Number of arguments.
+    @param argv     Optional number of days to simulate, then an optional
+                    script file of "<seconds> <action>" lines, where action
+                    is one of press, release, elements or digits.
+    @return         Zero if every check passed.
+*/
+int runEmulator(int argc, char** argv);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+    Host stand-in for the firmware entry point.
+
+    Mirrors src/main.c, which is not part of the host build.
+*/
+
+#include "firmware.h"
+#include "hal_host.h"
+#include "../src/io.h"
+#include "../src/clock.h"
+#include "../src/display.h"
+#include "../src/calibration.h"
+#include "../src/backup.h"
+#include "../src/adc.h"
+#include "../src/light.h"
+#include "../src/temperature.h"
+#include "../src/tick.h"
+#include "../src/scheduler.h"
+#include "../src/profile.h"
+#include "../src/serial.h"
+
+
+void setupFirmware()
+{
+    setupChipIo();
+#ifdef OSCILLATOR_CALIBRATION
+    loadCalibration();
+#endif
+#ifdef TEMPERATURE_COMPENSATION
+    loadTemperatureCurve();
+#endif
+#ifdef TIME_BACKUP
+    restoreClockTime();
+#endif
+#ifdef SERIAL_PORT
+    setupSerial();
+#endif
+#if defined(LIGHT_SENSOR) || defined(TEMPERATURE_COMPENSATION)
+    setupAdc();
+#endif
+    setupSystemTick();
+#ifdef BRIGHTNESS_LIGHT_SENSOR
+    setupLightSensor();
+#endif
+    sei();
+
+#ifdef OSCILLATOR_CALIBRATION
+    openCalibrationIfRequested();
+#endif
+}
+
+
+void runFirmwareMainLoop()
+{
+    runBackgroundTasks();
+    PROFILE_LOOP();
+}
+
+
+void runFirmwareUntil(uint64_t endCycle)
+{
+    while (hostCycles < endCycle)
+    {
+        if (hostRunUntilInterrupt(endCycle) != HOST_INTERRUPT_NONE)
+        {
+            runFirmwareMainLoop();
+        }
+    }
+}
@@ -0,0 +1,31 @@
+/**
+    Host stand-in for the firmware entry point.
+*/
+
+#ifndef FIRMWARE_H
+#define FIRMWARE_H
+
+#include <stdint.h>
+
+
+/**
+    Set up the simulated chip as main() does at power up.
+*/
+void setupFirmware();
+
+
+/**
+    Run one iteration of the firmware's main loop, up to where it sleeps.
+*/
+void runFirmwareMainLoop();
+
+
+/**
+    Run the firmware until a simulated cycle, idling between interrupts and
+    running the main loop after each one, as the chip does.
+
+    @param endCycle     The cycle to stop at.
+*/
+void runFirmwareUntil(uint64_t endCycle);
+
+#endif
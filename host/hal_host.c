@@ -0,0 +1,663 @@
+
+#include <string.h>
+
+#include "hal_host.h"
+
+
+volatile uint8_t DDRA;
+volatile uint8_t PORTA;
+volatile uint8_t PORTB;
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TIMSK1;
+volatile uint8_t TIFR1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+
+volatile uint8_t TCCR0A;
+volatile uint8_t TCCR0B;
+volatile uint8_t TIMSK0;
+volatile uint8_t TIFR0;
+volatile uint8_t OCR0A;
+
+volatile uint8_t GIMSK;
+volatile uint8_t GIFR;
+volatile uint8_t PCMSK0;
+volatile uint8_t PCMSK1;
+
+volatile uint8_t ADMUX;
+volatile uint8_t ADCSRA;
+volatile uint16_t ADC;
+volatile uint8_t DIDR0;
+
+uint64_t hostCycles = 0;
+uint64_t hostIdleCycles = 0;
+bool hostArePinsObserved = true;
+
+static bool interruptsEnabled = false;
+
+
+/**
+    Cycles taken by a single sbi/cbi/in instruction.
+*/
+#define PORT_ACCESS_CYCLES  2
+
+/**
+    Cycles taken by a single out instruction.
+*/
+#define USI_ACCESS_CYCLES   1
+
+/**
+    Port A pins the USI drives in three-wire mode.
+*/
+#define USI_PIN_DATA_OUT    (1 << PA5)
+#define USI_PIN_CLOCK       (1 << PA4)
+
+/**
+    Cycles taken to enter and leave an interrupt handler, including the
+    vector jump and saving the call-clobbered registers.
+*/
+#define ISR_OVERHEAD_CYCLES 40
+
+
+/**
+    Levels driven onto the pins from outside the chip.
+    Unconnected inputs read high through their pullups.
+*/
+static uint8_t externalPins = 0xff;
+static uint8_t externalPortBPins = 0xff;
+
+/**
+    Port B pin change interrupt flag. As with the timers, it is kept here
+    rather than in GIFR, and writing a one to GIFR clears it.
+*/
+static bool isPinChange1Pending = false;
+
+/**
+    USI registers, and whether USICR has been written since its last write
+    was carried out.
+*/
+static uint8_t usiControl = 0;
+static uint8_t usiData = 0;
+static bool isUsiControlWritten = false;
+
+
+void sei(void)
+{
+    interruptsEnabled = true;
+}
+
+
+void cli(void)
+{
+    interruptsEnabled = false;
+}
+
+
+uint32_t hostEepromWrites = 0;
+
+
+// Bounds of the EEMEM variables, provided by the linker.
+extern uint8_t __start_host_eeprom[];
+extern uint8_t __stop_host_eeprom[];
+
+
+void hostEraseEeprom(void)
+{
+    memset(__start_host_eeprom, 0xff, __stop_host_eeprom - __start_host_eeprom);
+}
+
+
+uint16_t eeprom_read_word(const uint16_t* address)
+{
+    return *address;
+}
+
+
+void eeprom_update_word(uint16_t* address, uint16_t value)
+{
+    eeprom_update_block(&value, address, sizeof(value));
+}
+
+
+void eeprom_read_block(void* destination, const void* source, size_t size)
+{
+    memcpy(destination, source, size);
+}
+
+
+void eeprom_update_block(const void* source, void* destination, size_t size)
+{
+    const uint8_t* from = source;
+    uint8_t* to = destination;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (to[i] != from[i])
+        {
+            to[i] = from[i];
+            hostEepromWrites++;
+        }
+    }
+}
+
+
+void _delay_us(double us)
+{
+    hostCycles += (uint64_t) (us * (F_CPU / 1000000.0) + 0.5);
+}
+
+
+void _delay_ms(double ms)
+{
+    _delay_us(ms * 1000.0);
+}
+
+
+void halEnableOutputs(uint8_t mask)
+{
+    DDRA |= mask;
+    hostCycles += PORT_ACCESS_CYCLES;
+}
+
+
+/**
+    Tell the observers about the port A outputs.
+*/
+static void notifyPinsChanged(void)
+{
+    if (hostArePinsObserved)
+    {
+        boardPinsChanged(PORTA & DDRA);
+        tracePinsChanged(PORTA & DDRA);
+        uartPinsChanged(PORTA & DDRA);
+    }
+}
+
+
+/**
+    Carry out the last write to USICR, then drive DO from the data
+    register's top bit.
+
+    A write with USITC toggles USCK, and one with USICLK shifts the data
+    register left, as in three-wire mode with the software clock strobe.
+*/
+static void updateUsi(void)
+{
+    if (isUsiControlWritten)
+    {
+        isUsiControlWritten = false;
+        if (usiControl & (1 << USITC))
+        {
+            PORTA ^= USI_PIN_CLOCK;
+            notifyPinsChanged();
+        }
+        if (usiControl & (1 << USICLK))
+        {
+            usiData <<= 1;
+        }
+    }
+
+    if (usiControl & (1 << USIWM0))
+    {
+        uint8_t dataOut = (usiData & 0x80) ? USI_PIN_DATA_OUT : 0;
+        if ((PORTA & USI_PIN_DATA_OUT) != dataOut)
+        {
+            PORTA ^= USI_PIN_DATA_OUT;
+            notifyPinsChanged();
+        }
+    }
+}
+
+
+volatile uint8_t* hostGetUsiControl(void)
+{
+    updateUsi();
+    hostCycles += USI_ACCESS_CYCLES;
+    isUsiControlWritten = true;
+    return &usiControl;
+}
+
+
+volatile uint8_t* hostGetUsiData(void)
+{
+    updateUsi();
+    hostCycles += USI_ACCESS_CYCLES;
+    return &usiData;
+}
+
+
+void halSetPins(uint8_t mask)
+{
+    updateUsi();
+    hostCycles += PORT_ACCESS_CYCLES;
+    PORTA |= mask;
+    notifyPinsChanged();
+}
+
+
+void halClearPins(uint8_t mask)
+{
+    updateUsi();
+    hostCycles += PORT_ACCESS_CYCLES;
+    PORTA &= ~mask;
+    notifyPinsChanged();
+}
+
+
+uint8_t halReadPins(void)
+{
+    hostCycles += PORT_ACCESS_CYCLES;
+    return (PORTA & DDRA) | (externalPins & ~DDRA);
+}
+
+
+void halSetPortBPins(uint8_t mask)
+{
+    hostCycles += PORT_ACCESS_CYCLES;
+    PORTB |= mask;
+}
+
+
+uint8_t halReadPortBPins(void)
+{
+    hostCycles += PORT_ACCESS_CYCLES;
+    return externalPortBPins;
+}
+
+
+void hostDrivePortBInputs(uint8_t mask, bool high)
+{
+    uint8_t pins = high ? (externalPortBPins | mask) : (externalPortBPins & ~mask);
+    if ((pins ^ externalPortBPins) & PCMSK1)
+    {
+        isPinChange1Pending = true;
+    }
+    externalPortBPins = pins;
+}
+
+
+/**
+    Apply writes to GIFR, which clear the pin change flags.
+*/
+static void updatePinChange()
+{
+    if (GIFR & (1 << PCIF1))
+    {
+        isPinChange1Pending = false;
+    }
+    GIFR = 0;
+}
+
+
+void hostDriveInputs(uint8_t mask, bool high)
+{
+    if (high)
+    {
+        externalPins |= mask;
+    }
+    else
+    {
+        externalPins &= ~mask;
+    }
+}
+
+
+/**
+    Simulated timer state.
+
+    Each timer runs in CTC or normal mode. It tracks the cycle its prescaler
+    was last brought up to date, so the counter can be advanced lazily.
+
+    The interrupt flags are kept here rather than in TIFR0 and TIFR1.
+    Writing ones to those registers clears the matching flags, as on the
+    chip, the next time the timer is brought up to date.
+*/
+typedef struct
+{
+    uint64_t lastCycle;
+    uint8_t flags;
+} TimerState;
+
+static TimerState timer0;
+static volatile uint8_t timer0Count;
+
+static TimerState timer1;
+static volatile uint16_t timer1Count;
+
+
+/**
+    Get the prescaler division selected by a timer's clock select bits.
+*/
+static uint32_t getPrescale(uint8_t clockSelect)
+{
+    static const uint32_t prescales[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    return prescales[clockSelect & 0x07];
+}
+
+
+/**
+    Get the number of timer ticks until a counter next equals a target.
+
+    In CTC mode the counter clears after reaching top. If it is already past
+    top it runs on to its maximum value and wraps to zero first.
+*/
+static uint32_t ticksUntil(uint32_t count, uint32_t top, uint32_t max, uint32_t target)
+{
+    if (count < target)
+    {
+        return target - count;
+    }
+    else if (count <= top)
+    {
+        return (top - count) + 1 + target;
+    }
+    else
+    {
+        return (max - count) + 1 + target;
+    }
+}
+
+
+/**
+    Advance a counter by a number of ticks.
+*/
+static uint32_t advanceCount(uint32_t count, uint32_t top, uint32_t max, uint64_t ticks)
+{
+    while (ticks > 0)
+    {
+        uint32_t toWrap = (count <= top) ? (top - count + 1) : (max - count + 1);
+        if (ticks < toWrap)
+        {
+            return count + ticks;
+        }
+
+        ticks -= toWrap;
+        count = 0;
+    }
+    return count;
+}
+
+
+/**
+    Get the value Timer1 clears after, which is OCR1A in CTC mode.
+*/
+static uint16_t getTimer1Top()
+{
+    return (TCCR1B & (1 << WGM12)) ? OCR1A : 0xffff;
+}
+
+
+/**
+    Bring Timer1 up to date with hostCycles, setting compare flags.
+*/
+static void updateTimer1()
+{
+    timer1.flags &= ~TIFR1;
+    TIFR1 = 0;
+
+    uint32_t prescale = getPrescale(TCCR1B);
+    if (prescale == 0)
+    {
+        timer1.lastCycle = hostCycles;
+        return;
+    }
+
+    uint64_t ticks = (hostCycles - timer1.lastCycle) / prescale;
+    timer1.lastCycle += ticks * prescale;
+
+    uint16_t top = getTimer1Top();
+    if (ticks >= ticksUntil(timer1Count, top, 0xffff, OCR1A))
+    {
+        timer1.flags |= (1 << OCF1A);
+    }
+    if (ticks >= ticksUntil(timer1Count, top, 0xffff, OCR1B) && OCR1B <= top)
+    {
+        timer1.flags |= (1 << OCF1B);
+    }
+    timer1Count = advanceCount(timer1Count, top, 0xffff, ticks);
+}
+
+
+volatile uint16_t* hostGetTimer1Count(void)
+{
+    updateTimer1();
+    return &timer1Count;
+}
+
+
+/**
+    Get the value Timer0 clears after, which is OCR0A in CTC mode.
+*/
+static uint8_t getTimer0Top()
+{
+    return (TCCR0A & (1 << WGM01)) ? OCR0A : 0xff;
+}
+
+
+/**
+    Bring Timer0 up to date with hostCycles, setting the compare A flag.
+*/
+static void updateTimer0()
+{
+    timer0.flags &= ~TIFR0;
+    TIFR0 = 0;
+
+    uint32_t prescale = getPrescale(TCCR0B);
+    if (prescale == 0)
+    {
+        timer0.lastCycle = hostCycles;
+        return;
+    }
+
+    uint64_t ticks = (hostCycles - timer0.lastCycle) / prescale;
+    timer0.lastCycle += ticks * prescale;
+
+    uint8_t top = getTimer0Top();
+    if (ticks >= ticksUntil(timer0Count, top, 0xff, OCR0A))
+    {
+        timer0.flags |= (1 << OCF0A);
+    }
+    timer0Count = advanceCount(timer0Count, top, 0xff, ticks);
+}
+
+
+volatile uint8_t* hostGetTimer0Count(void)
+{
+    updateTimer0();
+    return &timer0Count;
+}
+
+
+/**
+    Simulated ADC state.
+
+    A conversion starts when ADSC is found set, and finishes a fixed number
+    of ADC clocks later. As with Timer1, the interrupt flag is kept here.
+*/
+#define ADC_CONVERSION_CLOCKS   13
+
+static bool isAdcConverting = false;
+static uint64_t adcDoneCycle;
+static bool isAdcFlagSet = false;
+
+
+/**
+    Bring the ADC up to date with hostCycles, starting and finishing
+    conversions.
+*/
+static void updateAdc()
+{
+    if ( ! (ADCSRA & (1 << ADEN)))
+    {
+        isAdcConverting = false;
+        ADCSRA &= ~(1 << ADSC);
+        return;
+    }
+
+    if ( ! isAdcConverting && (ADCSRA & (1 << ADSC)))
+    {
+        // The ADC clock prescaler, with 0 also dividing by 2.
+        uint32_t prescale = 1 << (ADCSRA & 0x07);
+        prescale = (prescale < 2) ? 2 : prescale;
+
+        isAdcConverting = true;
+        adcDoneCycle = hostCycles + ADC_CONVERSION_CLOCKS * prescale;
+    }
+
+    if (isAdcConverting && hostCycles >= adcDoneCycle)
+    {
+        isAdcConverting = false;
+        ADC = boardReadAdc(ADMUX & 0x3f);
+        ADCSRA &= ~(1 << ADSC);
+        isAdcFlagSet = true;
+    }
+}
+
+
+/**
+    Bring the simulated peripherals up to date with hostCycles.
+*/
+static void updatePeripherals()
+{
+    updateTimer0();
+    updateTimer1();
+    updateAdc();
+    updatePinChange();
+}
+
+
+/**
+    Get the cycle of the next enabled compare match or ADC conversion
+    result, or limit if sooner.
+*/
+static uint64_t getNextEventCycle(uint64_t limit)
+{
+    uint64_t next = limit;
+
+    if (isAdcConverting && (ADCSRA & (1 << ADIE)))
+    {
+        next = (adcDoneCycle < next) ? adcDoneCycle : next;
+    }
+
+    uint32_t timer0Prescale = getPrescale(TCCR0B);
+    if (timer0Prescale != 0 && (TIMSK0 & (1 << OCIE0A)))
+    {
+        uint64_t cycle = timer0.lastCycle + (uint64_t) ticksUntil(timer0Count, getTimer0Top(), 0xff, OCR0A) * timer0Prescale;
+        next = (cycle < next) ? cycle : next;
+    }
+
+    uint32_t prescale = getPrescale(TCCR1B);
+    if (prescale == 0)
+    {
+        return next;
+    }
+
+    uint16_t top = getTimer1Top();
+    if (TIMSK1 & (1 << OCIE1A))
+    {
+        uint64_t cycle = timer1.lastCycle + (uint64_t) ticksUntil(timer1Count, top, 0xffff, OCR1A) * prescale;
+        next = (cycle < next) ? cycle : next;
+    }
+    if ((TIMSK1 & (1 << OCIE1B)) && OCR1B <= top)
+    {
+        uint64_t cycle = timer1.lastCycle + (uint64_t) ticksUntil(timer1Count, top, 0xffff, OCR1B) * prescale;
+        next = (cycle < next) ? cycle : next;
+    }
+
+    return next;
+}
+
+
+/**
+    Service the highest priority pending interrupt, if any.
+*/
+static HostInterrupt dispatchInterrupt()
+{
+    if ( ! interruptsEnabled)
+    {
+        return HOST_INTERRUPT_NONE;
+    }
+
+    HostInterrupt interrupt = HOST_INTERRUPT_NONE;
+    if (isPinChange1Pending && (GIMSK & (1 << PCIE1)))
+    {
+        isPinChange1Pending = false;
+        interrupt = HOST_INTERRUPT_PCINT1;
+    }
+    else if ((timer1.flags & (1 << OCF1A)) && (TIMSK1 & (1 << OCIE1A)))
+    {
+        timer1.flags &= ~(1 << OCF1A);
+        interrupt = HOST_INTERRUPT_TIM1_COMPA;
+    }
+    else if ((timer1.flags & (1 << OCF1B)) && (TIMSK1 & (1 << OCIE1B)))
+    {
+        timer1.flags &= ~(1 << OCF1B);
+        interrupt = HOST_INTERRUPT_TIM1_COMPB;
+    }
+    else if ((timer0.flags & (1 << OCF0A)) && (TIMSK0 & (1 << OCIE0A)))
+    {
+        timer0.flags &= ~(1 << OCF0A);
+        interrupt = HOST_INTERRUPT_TIM0_COMPA;
+    }
+    else if (isAdcFlagSet && (ADCSRA & (1 << ADIE)))
+    {
+        isAdcFlagSet = false;
+        interrupt = HOST_INTERRUPT_ADC;
+    }
+    else
+    {
+        return HOST_INTERRUPT_NONE;
+    }
+
+    // Interrupts are disabled while a handler runs, as on the chip.
+    interruptsEnabled = false;
+    hostCycles += ISR_OVERHEAD_CYCLES;
+    switch (interrupt)
+    {
+        case HOST_INTERRUPT_PCINT1:
+            PCINT1_vect();
+            break;
+
+        case HOST_INTERRUPT_TIM1_COMPA:
+            TIM1_COMPA_vect();
+            break;
+
+        case HOST_INTERRUPT_TIM1_COMPB:
+            TIM1_COMPB_vect();
+            break;
+
+        case HOST_INTERRUPT_TIM0_COMPA:
+            TIM0_COMPA_vect();
+            break;
+
+        case HOST_INTERRUPT_ADC:
+            ADC_vect();
+            break;
+
+        default:
+            break;
+    }
+    interruptsEnabled = true;
+
+    updatePeripherals();
+    return interrupt;
+}
+
+
+HostInterrupt hostRunUntilInterrupt(uint64_t limit)
+{
+    updatePeripherals();
+
+    HostInterrupt interrupt = dispatchInterrupt();
+    if (interrupt != HOST_INTERRUPT_NONE || hostCycles >= limit)
+    {
+        return interrupt;
+    }
+
+    uint64_t nextCycle = getNextEventCycle(limit);
+    hostIdleCycles += nextCycle - hostCycles;
+    hostCycles = nextCycle;
+    updatePeripherals();
+    return dispatchInterrupt();
+}
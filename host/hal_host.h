@@ -0,0 +1,291 @@
+/**
+    Simulated ATtiny44A for host builds.
+
+    Provides the subset of avr-libc used by the firmware. Registers are
+    plain variables, interrupt handlers become ordinary functions that the
+    host harness calls directly, and busy-wait delays advance a simulated
+    CPU cycle counter instead of sleeping.
+*/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+    Simulated registers.
+*/
+extern volatile uint8_t DDRA;
+extern volatile uint8_t PORTA;
+extern volatile uint8_t PORTB;
+
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t TIFR0;
+extern volatile uint8_t OCR0A;
+
+extern volatile uint8_t GIMSK;
+extern volatile uint8_t GIFR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint16_t ADC;
+extern volatile uint8_t DIDR0;
+
+
+/**
+    Timer1's counter is brought up to date whenever it is accessed, so the
+    firmware can time its own code against the simulated cycle count.
+*/
+volatile uint16_t* hostGetTimer1Count(void);
+#define TCNT1   (*hostGetTimer1Count())
+
+volatile uint8_t* hostGetTimer0Count(void);
+#define TCNT0   (*hostGetTimer0Count())
+
+/**
+    Each access to the USI registers first carries out the last write to
+    USICR, so its clock strobes reach the pins as the firmware makes them.
+    The firmware only ever writes USICR.
+*/
+volatile uint8_t* hostGetUsiControl(void);
+#define USICR   (*hostGetUsiControl())
+
+volatile uint8_t* hostGetUsiData(void);
+#define USIDR   (*hostGetUsiData())
+
+
+/**
+    Register bit positions.
+*/
+enum
+{
+    PA0 = 0, PA1 = 1, PA2 = 2, PA3 = 3, PA4 = 4, PA5 = 5, PA6 = 6, PA7 = 7,
+    PB0 = 0, PB1 = 1, PB2 = 2, PB3 = 3,
+
+    WGM01 = 1,
+    CS00 = 0, CS01 = 1, CS02 = 2,
+    OCIE0A = 1,
+    OCF0A = 1,
+
+    WGM12 = 3,
+    CS10 = 0, CS11 = 1, CS12 = 2,
+    OCIE1A = 1, OCIE1B = 2,
+    OCF1A = 1, OCF1B = 2,
+
+    USITC = 0, USICLK = 1, USIWM0 = 4,
+
+    PCIE0 = 4, PCIE1 = 5,
+    PCIF0 = 4, PCIF1 = 5,
+    PCINT10 = 2,
+
+    ADEN = 7, ADSC = 6, ADATE = 5, ADIF = 4, ADIE = 3,
+    ADPS2 = 2, ADPS1 = 1, ADPS0 = 0,
+    REFS1 = 7, REFS0 = 6, MUX5 = 5, MUX1 = 1,
+};
+
+
+/**
+    Interrupt vectors.
+
+    The firmware's ISR() definitions become these functions.
+*/
+#define ISR(vector)             void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) {}
+
+void TIM1_COMPA_vect(void);
+void TIM1_COMPB_vect(void);
+void PCINT0_vect(void);
+void PCINT1_vect(void);
+void TIM0_COMPA_vect(void);
+void ADC_vect(void);
+
+void sei(void);
+void cli(void);
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type)  for (bool atomicDone_ = false; ! atomicDone_; atomicDone_ = true)
+
+
+/**
+    Program memory lives in ordinary memory on the host.
+*/
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t*) (address))
+#define pgm_read_word(address)  (*(const uint16_t*) (address))
+#define pgm_read_dword(address) (*(const uint32_t*) (address))
+#define pgm_read_ptr(address)   (*(void* const*) (address))
+
+
+/**
+    EEPROM variables live in ordinary memory on the host, gathered into one
+    section so they can be erased together. Updates only count as writes
+    if the value changes.
+*/
+#define EEMEM   __attribute__((section("host_eeprom")))
+
+uint16_t eeprom_read_word(const uint16_t* address);
+void eeprom_update_word(uint16_t* address, uint16_t value);
+void eeprom_read_block(void* destination, const void* source, size_t size);
+void eeprom_update_block(const void* source, void* destination, size_t size);
+
+
+/**
+    Number of EEPROM bytes written.
+*/
+extern uint32_t hostEepromWrites;
+
+
+/**
+    Erase the simulated EEPROM, as on a newly programmed chip.
+*/
+void hostEraseEeprom(void);
+
+
+/**
+    Sleep is modelled by the harness, which idles the simulated CPU until
+    the next interrupt with hostRunUntilInterrupt().
+*/
+#define SLEEP_MODE_IDLE         0
+#define set_sleep_mode(mode)
+#define sleep_mode()
+
+
+/**
+    Busy-wait delays advance the simulated cycle counter.
+*/
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+
+/**
+    Port A access, see hal.h.
+*/
+void halEnableOutputs(uint8_t mask);
+void halSetPins(uint8_t mask);
+void halClearPins(uint8_t mask);
+uint8_t halReadPins(void);
+void halSetPortBPins(uint8_t mask);
+uint8_t halReadPortBPins(void);
+
+
+/**
+    Simulated CPU cycles spent in delays and port accesses.
+*/
+extern uint64_t hostCycles;
+
+
+/**
+    Simulated CPU cycles spent idle, waiting for an interrupt.
+*/
+extern uint64_t hostIdleCycles;
+
+
+/**
+    Whether port A output changes are passed on to the simulated board,
+    trace recorder and serial terminal. True by default. Long runs that
+    don't look at the pins can clear it, so that shifting out the display
+    only counts cycles.
+*/
+extern bool hostArePinsObserved;
+
+
+/**
+    Set the level an external device drives onto port A input pins.
+
+    @param mask     The pins to change.
+    @param high     True to drive the pins high, False to pull them low.
+*/
+void hostDriveInputs(uint8_t mask, bool high);
+
+
+/**
+    Set the level an external device drives onto port B pins, raising a
+    pin change interrupt for enabled pins that change.
+
+    @param mask     The pins to change.
+    @param high     True to drive the pins high, False to pull them low.
+*/
+void hostDrivePortBInputs(uint8_t mask, bool high);
+
+
+/**
+    Interrupts dispatched by the simulated chip, in priority order.
+*/
+typedef enum
+{
+    HOST_INTERRUPT_NONE,
+    HOST_INTERRUPT_PCINT1,
+    HOST_INTERRUPT_TIM1_COMPA,
+    HOST_INTERRUPT_TIM1_COMPB,
+    HOST_INTERRUPT_TIM0_COMPA,
+    HOST_INTERRUPT_ADC,
+} HostInterrupt;
+
+
+/**
+    Run the simulated timers until the next interrupt is serviced.
+
+    Time advances to the next enabled Timer0 or Timer1 compare match or ADC
+    conversion result, and the highest
+    priority pending interrupt is dispatched. The CPU is counted as idle
+    while waiting. The handler's delays and a
+    fixed entry/exit overhead are added to hostCycles.
+
+    @param limit    Stop at this cycle if no interrupt happens before it.
+    @return         The interrupt that was serviced, or HOST_INTERRUPT_NONE
+                    if the limit was reached first.
+*/
+HostInterrupt hostRunUntilInterrupt(uint64_t limit);
+
+
+/**
+    Called by the simulated chip whenever port A outputs change.
+    Implemented by the simulated board.
+
+    @param pins     The new port A output levels.
+*/
+void boardPinsChanged(uint8_t pins);
+
+
+/**
+    Called by the simulated chip whenever port A outputs change.
+    Implemented by the trace recorder.
+
+    @param pins     The new port A output levels.
+*/
+void tracePinsChanged(uint8_t pins);
+
+
+/**
+    Called by the simulated chip whenever port A outputs change.
+    Implemented by the simulated serial terminal.
+
+    @param pins     The new port A output levels.
+*/
+void uartPinsChanged(uint8_t pins);
+
+
+/**
+    Called by the simulated chip when an ADC conversion completes.
+    Implemented by the simulated board.
+
+    @param channel  The input selected by the ADMUX MUX bits.
+    @return         The conversion result, 0 to 1023.
+*/
+uint16_t boardReadAdc(uint8_t channel);
+
+#endif
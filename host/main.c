@@ -0,0 +1,708 @@
+/**
+    Host harness for the element clock firmware.
+
+    Runs the firmware's clock and display logic against the simulated chip
+    in hal_host.c, so the hot paths can be exercised without hardware.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal_host.h"
+#include "emulator.h"
+#include "firmware.h"
+#include "trace.h"
+#include "drift.h"
+#include "board.h"
+#include "uart.h"
+#include "../src/io.h"
+#include "../src/clock.h"
+#include "../src/display.h"
+#include "../src/calibration.h"
+#include "../src/timeset.h"
+#include "../src/scheduler.h"
+#include "../src/tick.h"
+#include "../src/light.h"
+#include "../src/brightness.h"
+#include "../src/profile.h"
+#include "../src/serial.h"
+#include "../src/temperature.h"
+
+
+#define BENCH_ITERATIONS        1000000
+#define POWER_PROFILE_SECONDS   10
+#define TASK_PROFILE_HOLD_SECONDS   3
+#define TASK_PROFILE_SECONDS        70
+#define CALIBRATION_CHECK_SECONDS   600
+#define LIGHT_SETTLE_SECONDS        3
+#define LIGHT_HOVER_SECONDS         30
+#define LIGHT_RAMP_SECONDS          30
+#define DIAGNOSTIC_SECONDS          30
+#define SERIAL_REPLY_SECONDS        2
+#define SERIAL_SETTLE_SECONDS       5
+#define SERIAL_PTY_STEP_CYCLES      (F_CPU / 100)
+
+// Largest allowed difference between a second set over the serial port
+// and the end of the command line, in system ticks.
+#define SERIAL_SYNC_LIMIT_TICKS     2
+
+// Largest allowed difference between the mean clock period and the
+// trimmed period, in parts per million.
+#define CALIBRATION_CHECK_LIMIT 0.1
+
+
+static double getWallTimeNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+
+/**
+    Time a firmware routine.
+
+    Reports host nanoseconds per call, and the simulated AVR cycles spent in
+    delays and port accesses per call. The latter is a lower bound on the
+    routine's cost on the chip.
+*/
+static void bench(const char* name, void (*function)(void))
+{
+    uint64_t startCycles = hostCycles;
+    double startNs = getWallTimeNs();
+
+    for (long i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        function();
+    }
+
+    double elapsedNs = getWallTimeNs() - startNs;
+    uint64_t elapsedCycles = hostCycles - startCycles;
+
+    printf("%-24s %8.1f ns/call %8.1f avr cycles/call\n",
+        name,
+        elapsedNs / BENCH_ITERATIONS,
+        (double) elapsedCycles / BENCH_ITERATIONS);
+}
+
+
+static void countClockTickOnce()
+{
+    countClockTick();
+}
+
+
+static void shiftOutTestWord()
+{
+    shiftOutWord((ShiftWord) 0xa5a5a5a5);
+}
+
+
+static void rebuildDisplay()
+{
+    invalidateDisplay();
+    updateDisplay();
+}
+
+
+/**
+    Flip the mode switch and sample it until the input snapshot follows.
+*/
+static void selectElementMode(bool isElementMode)
+{
+    hostDriveInputs(IO_PIN_ELEMENT_MODE_SWITCH, ! isElementMode);
+    for (uint8_t i = 0; i < INPUT_DEBOUNCE_SAMPLES; ++i)
+    {
+        sampleInputs();
+    }
+}
+
+
+static int runBenchmarks()
+{
+    selectElementMode(false);
+    bench("system tick", TIM1_COMPA_vect);
+    bench("refresh digit", refreshDisplay);
+    bench("blank digit", TIM1_COMPB_vect);
+    bench("shift word", shiftOutTestWord);
+    bench("rebuild frame (digits)", rebuildDisplay);
+    bench("cached frame", updateDisplay);
+
+    selectElementMode(true);
+    bench("rebuild frame (elements)", rebuildDisplay);
+
+    bench("clock tick", countClockTickOnce);
+    bench("input sample", sampleInputs);
+    bench("time set", updateTimeSet);
+    return 0;
+}
+
+
+/**
+    Measure the fraction of time the CPU is awake in one display mode.
+*/
+static void profilePower(const char* name, bool isElementMode, uint8_t hours)
+{
+    selectElementMode(isElementMode);
+    setClockTime(hours, 8, 0);
+    runFirmwareUntil(hostCycles + F_CPU);
+
+    uint64_t startCycles = hostCycles;
+    uint64_t startIdleCycles = hostIdleCycles;
+    runFirmwareUntil(hostCycles + POWER_PROFILE_SECONDS * F_CPU);
+
+    double idle = (double) (hostIdleCycles - startIdleCycles) / (hostCycles - startCycles);
+    printf("%-24s CPU active %5.1f %%\n", name, (1 - idle) * 100);
+}
+
+
+static int runPowerProfile()
+{
+    profilePower("digits, day", false, 10);
+    profilePower("digits, night", false, 21);
+    profilePower("elements, day", true, 10);
+    profilePower("elements, night", true, 21);
+    return 0;
+}
+
+
+/**
+    Task names, indexed by TaskId.
+*/
+static const char* const taskNames[TASK_COUNT] = {
+    [TASK_REFRESH_DISPLAY]  = "refresh display",
+    [TASK_SAMPLE_INPUTS]    = "sample inputs",
+    [TASK_UPDATE_TIME_SET]  = "update time set",
+    [TASK_UPDATE_CALIBRATION] = "update calibration",
+    [TASK_FADE_DISPLAY]     = "fade display",
+    [TASK_BLINK_DISPLAY]    = "blink display",
+    [TASK_SAMPLE_LIGHT]     = "sample light",
+    [TASK_UPDATE_DISPLAY]   = "update display",
+    [TASK_SAVE_CLOCK_TIME]  = "save clock time",
+    [TASK_SAMPLE_TEMPERATURE] = "sample temperature",
+    [TASK_SERVICE_SERIAL]   = "service serial",
+};
+
+
+/**
+    Run the firmware through a time set and a saved minute, then report the
+    scheduler's worst case execution times and overruns for each task.
+*/
+static int runTaskProfile()
+{
+    runFirmwareUntil(hostCycles + F_CPU);
+
+    hostDriveInputs(IO_PIN_SPEED_BUTTON, false);
+    runFirmwareUntil(hostCycles + TASK_PROFILE_HOLD_SECONDS * F_CPU);
+    hostDriveInputs(IO_PIN_SPEED_BUTTON, true);
+
+    selectElementMode(true);
+    runFirmwareUntil(hostCycles + TASK_PROFILE_SECONDS * F_CPU);
+
+    for (uint8_t task = 0; task < TASK_COUNT; ++task)
+    {
+        double worstCaseUs = getTaskWorstCase(task) * (TICK_TIMER_PRESCALE * 1e6 / F_CPU);
+        printf("%-24s worst case %8.0f us   overruns %3u\n",
+            taskNames[task], worstCaseUs, getTaskOverruns(task));
+    }
+    return 0;
+}
+
+
+/**
+    Measure the mean length of a second with a trim applied.
+
+    Seconds are measured by adding up the tick periods scheduled on Timer1,
+    so the time the host spends running the handlers doesn't count.
+
+    @return     True if the period matches the trim.
+*/
+static bool checkClockTrim(int16_t trim)
+{
+    setClockTrim(trim);
+
+    // Start counting from the first whole second with the new trim.
+    uint8_t previousSecondsBcd = CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot());
+    uint16_t previousStartCount = getTickStartCount();
+    uint64_t counts = 0;
+    int32_t seconds = -2;
+
+    while (seconds < CALIBRATION_CHECK_SECONDS)
+    {
+        if (hostRunUntilInterrupt(UINT64_MAX) != HOST_INTERRUPT_TIM1_COMPA)
+        {
+            continue;
+        }
+
+        uint16_t startCount = getTickStartCount();
+        counts += (uint16_t) (startCount - previousStartCount);
+        previousStartCount = startCount;
+
+        uint8_t secondsBcd = CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot());
+        if (secondsBcd != previousSecondsBcd)
+        {
+            previousSecondsBcd = secondsBcd;
+            seconds++;
+            if (seconds == 0)
+            {
+                counts = 0;
+            }
+        }
+    }
+
+    double period = (double) counts * TICK_TIMER_PRESCALE / CALIBRATION_CHECK_SECONDS;
+    double trimmedPeriod = F_CPU * (1 + trim / 1e6);
+    double error = (period / trimmedPeriod - 1) * 1e6;
+    bool isPassing = fabs(error) < CALIBRATION_CHECK_LIMIT;
+
+    printf("trim %+5d ppm   period %12.3f cycles   error %+8.4f ppm   %s\n",
+        trim, period, error, isPassing ? "ok" : "FAIL");
+    return isPassing;
+}
+
+
+/**
+    Open the calibration screen and press the speed button twice. The
+    clock and the background tasks must keep running while it is open,
+    and the screen must save the stepped trim when it closes.
+*/
+static bool checkCalibrationScreen()
+{
+    setClockTrim(0);
+    hostDriveInputs(IO_PIN_SPEED_BUTTON, false);
+    runFirmwareUntil(hostCycles + F_CPU / 10);
+    openCalibrationIfRequested();
+    bool isOpened = isCalibrationOpen();
+
+    // Release the press that opened the screen, then press twice.
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        hostDriveInputs(IO_PIN_SPEED_BUTTON, true);
+        runFirmwareUntil(hostCycles + F_CPU / 10);
+        hostDriveInputs(IO_PIN_SPEED_BUTTON, false);
+        runFirmwareUntil(hostCycles + F_CPU / 10);
+    }
+    hostDriveInputs(IO_PIN_SPEED_BUTTON, true);
+
+    uint32_t startSnapshot = getClockSnapshot();
+    runFirmwareUntil(hostCycles + 4 * F_CPU);
+    bool isRunning = isCalibrationOpen() && getClockSnapshot() != startSnapshot;
+
+    runFirmwareUntil(hostCycles + 2 * F_CPU);
+    bool isSaved = ! isCalibrationOpen() && getClockTrim() == 2;
+    setClockTrim(0);
+    loadCalibration();
+    isSaved &= (getClockTrim() == 2);
+
+    bool isPassing = isOpened && isRunning && isSaved;
+    printf("calibration screen   opened %s   running %s   saved %s   %s\n",
+        isOpened ? "yes" : "no", isRunning ? "yes" : "no", isSaved ? "yes" : "no",
+        isPassing ? "ok" : "FAIL");
+    return isPassing;
+}
+
+
+static int runCalibrationCheck()
+{
+    static const int16_t trims[] = { -999, -500, -65, -9, -8, -1, 0, 1, 7, 8, 37, 100, 999 };
+
+    printf("F_CPU %lu Hz   Timer1 / %u   %u counts per tick   %g ppm per count\n",
+        (unsigned long) F_CPU, TICK_TIMER_PRESCALE, TICK_TIMER_COUNT,
+        1e6 * TICK_TIMER_PRESCALE / F_CPU);
+
+    bool isPassing = true;
+    for (size_t i = 0; i < sizeof(trims) / sizeof(trims[0]); ++i)
+    {
+        isPassing &= checkClockTrim(trims[i]);
+    }
+    isPassing &= checkCalibrationScreen();
+
+    printf("%s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}
+
+
+/**
+    Run the firmware with the simulated light level held, counting changes
+    of the ambient brightness level.
+
+    @param rising   Set to the number of changes to a brighter level.
+    @param falling  Set to the number of changes to a dimmer level.
+*/
+static void runLight(uint16_t level, uint16_t noise, uint32_t seconds, uint32_t* rising, uint32_t* falling)
+{
+    boardLightLevel = level;
+    boardLightNoise = noise;
+
+    *rising = 0;
+    *falling = 0;
+    uint8_t brightness = getAmbientBrightness();
+    uint64_t endCycle = hostCycles + (uint64_t) seconds * F_CPU;
+    while (hostCycles < endCycle)
+    {
+        runFirmwareUntil(hostCycles + F_CPU / TICK_RATE_HZ);
+
+        uint8_t newBrightness = getAmbientBrightness();
+        *rising += (newBrightness > brightness);
+        *falling += (newBrightness < brightness);
+        brightness = newBrightness;
+    }
+}
+
+
+static bool checkLight(const char* name, bool isPassing)
+{
+    printf("%-32s light %4u   brightness %u   %s\n",
+        name, getAmbientLight(), getAmbientBrightness(), isPassing ? "ok" : "FAIL");
+    return isPassing;
+}
+
+
+/**
+    Check the ambient light filter: the brightness should follow the room,
+    without flickering when the light hovers by a threshold or the sensor
+    is noisy.
+*/
+static int runLightCheck()
+{
+    setupLightSensor();
+
+    uint32_t rising;
+    uint32_t falling;
+    bool isPassing = true;
+
+    runLight(0, 0, LIGHT_SETTLE_SECONDS, &rising, &falling);
+    isPassing &= checkLight("dark", getAmbientBrightness() == 0);
+
+    runLight(LIGHT_ADC_MAX, 0, LIGHT_SETTLE_SECONDS, &rising, &falling);
+    isPassing &= checkLight("bright", getAmbientBrightness() == BRIGHTNESS_MAX && falling == 0);
+
+    // Hover right on the threshold between two levels, with noise of half
+    // the threshold on each reading.
+    const uint16_t threshold = 64;
+    runLight(threshold, 0, LIGHT_SETTLE_SECONDS, &rising, &falling);
+    runLight(threshold, threshold / 2, LIGHT_HOVER_SECONDS, &rising, &falling);
+    isPassing &= checkLight("noisy threshold", rising + falling == 0);
+
+    // Dim the room steadily to dark, from bright.
+    runLight(LIGHT_ADC_MAX, 0, LIGHT_SETTLE_SECONDS, &rising, &falling);
+    uint32_t rampRising = 0;
+    uint32_t rampFalling = 0;
+    for (uint32_t second = 0; second <= LIGHT_RAMP_SECONDS; ++second)
+    {
+        uint16_t level = LIGHT_ADC_MAX - (uint32_t) LIGHT_ADC_MAX * second / LIGHT_RAMP_SECONDS;
+        runLight(level, level / 8, 1, &rising, &falling);
+        rampRising += rising;
+        rampFalling += falling;
+    }
+    runLight(0, 0, LIGHT_SETTLE_SECONDS, &rising, &falling);
+    rampRising += rising;
+    rampFalling += falling;
+    isPassing &= checkLight("dimming", getAmbientBrightness() == 0 && rampRising == 0 && rampFalling == BRIGHTNESS_MAX);
+
+    printf("%s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}
+
+
+/**
+    Run the firmware in real time, with a pseudo terminal standing in for
+    its serial port.
+*/
+static int runSerialTerminal()
+{
+    const char* name;
+    int fd = openUartPty(&name);
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    printf("serial port on %s at %u baud, 8N1\n", name, SERIAL_BAUD);
+    fflush(stdout);
+
+    uint64_t startCycle = hostCycles;
+    double startNs = getWallTimeNs();
+    for (;;)
+    {
+        pumpUartPty(fd);
+        runUartUntil(hostCycles + SERIAL_PTY_STEP_CYCLES);
+        pumpUartPty(fd);
+
+        // Keep pace with the wall clock.
+        double aheadNs = (hostCycles - startCycle) * (1e9 / F_CPU) - (getWallTimeNs() - startNs);
+        if (aheadNs > 0)
+        {
+            struct timespec delay = { 0, (long) aheadNs };
+            nanosleep(&delay, NULL);
+        }
+    }
+}
+
+
+/**
+    Send a command line through the pseudo terminal, and wait for the reply.
+
+    @param master   The master side, which the firmware is on.
+    @param slave    The slave side, which the command is sent from.
+    @param command  The command, without the line ending.
+    @param reply    Filled with the reply line, without the newline.
+    @return         True if a whole line was received in time.
+*/
+static bool exchangeSerial(int master, int slave, const char* command, char* reply, size_t size)
+{
+    char line[32];
+    snprintf(line, sizeof(line), "%s\r\n", command);
+    if (write(slave, line, strlen(line)) < 0)
+    {
+        perror("pty");
+        return false;
+    }
+
+    size_t length = 0;
+    uint64_t endCycle = hostCycles + (uint64_t) SERIAL_REPLY_SECONDS * F_CPU;
+    while (hostCycles < endCycle)
+    {
+        pumpUartPty(master);
+        runUartUntil(hostCycles + F_CPU / 1000);
+        pumpUartPty(master);
+
+        char c;
+        while (length < size - 1 && read(slave, &c, 1) == 1)
+        {
+            if (c == '\n')
+            {
+                reply[length] = '\0';
+                printf("> %-12s < %s\n", command, reply);
+                return true;
+            }
+            reply[length++] = c;
+        }
+    }
+
+    reply[length] = '\0';
+    printf("> %-12s < %s (no newline)\n", command, reply);
+    return false;
+}
+
+
+/**
+    Count the space separated fields of a reply, after the command.
+*/
+static unsigned countFields(const char* reply)
+{
+    unsigned count = 0;
+    for (const char* c = reply; *c != '\0'; ++c)
+    {
+        count += (*c == ' ');
+    }
+    return count;
+}
+
+
+/**
+    Check the serial protocol end to end, through a pseudo terminal: each
+    command should get the right reply, a time set should start the new
+    second in step with the end of its line, and the display should keep
+    refreshing throughout.
+*/
+static int runSerialCheck()
+{
+    const char* name;
+    int master = openUartPty(&name);
+    int slave = (master < 0) ? -1 : open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (slave < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+
+    // Away from the turnover of the temperature curve set below, and long
+    // enough for the filter to settle.
+    boardTemperature = 35;
+    runUartUntil(hostCycles + SERIAL_SETTLE_SECONDS * F_CPU);
+
+    char reply[128];
+    char expected[32];
+    bool isPassing = true;
+
+    isPassing &= exchangeSerial(master, slave, "T123456", reply, sizeof(reply)) &&
+        strcmp(reply, "T 123456") == 0;
+
+    // The clock should count the new second from the end of the line, at
+    // the carriage return.
+    uint64_t setCycle = getUartSentCycle() - 10 * F_CPU / SERIAL_BAUD;
+    while (CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot()) == 0x56 && hostCycles < setCycle + 2 * F_CPU)
+    {
+        runUartUntil(hostCycles + 16);
+    }
+    double syncTicks = ((double) hostCycles - setCycle - F_CPU) * TICK_RATE_HZ / F_CPU;
+    bool isSynced = fabs(syncTicks) <= SERIAL_SYNC_LIMIT_TICKS;
+    printf("%-27s %+.2f ticks   %s\n", "second after set", syncTicks, isSynced ? "ok" : "FAIL");
+    isPassing &= isSynced;
+
+    isPassing &= exchangeSerial(master, slave, "T", reply, sizeof(reply)) &&
+        strncmp(reply, "T 1234", 6) == 0;
+
+    snprintf(expected, sizeof(expected), "K %d", getClockTrim());
+    isPassing &= exchangeSerial(master, slave, "K", reply, sizeof(reply)) &&
+        strcmp(reply, expected) == 0;
+
+    // A new temperature curve should be followed within a second.
+    isPassing &= exchangeSerial(master, slave, "C+25+16-09", reply, sizeof(reply)) &&
+        strncmp(reply, "C ", 2) == 0;
+    runUartUntil(hostCycles + F_CPU);
+    snprintf(expected, sizeof(expected), "C %d,%d", getTemperature(), getClockCompensation());
+    isPassing &= exchangeSerial(master, slave, "C", reply, sizeof(reply)) &&
+        strcmp(reply, expected) == 0 && getTemperature() == 35 && getClockCompensation() != 0;
+
+    isPassing &= exchangeSerial(master, slave, "W", reply, sizeof(reply)) &&
+        reply[0] == 'W' && countFields(reply) == TASK_COUNT;
+
+#ifdef PROFILE
+    isPassing &= exchangeSerial(master, slave, "P", reply, sizeof(reply)) &&
+        reply[0] == 'P' && countFields(reply) == PROFILE_POINT_COUNT + 2;
+#endif
+
+    static const char* const badCommands[] = { "T246000", "T12345x", "T1234567", "C+25+04-9x", "X" };
+    for (size_t i = 0; i < sizeof(badCommands) / sizeof(badCommands[0]); ++i)
+    {
+        isPassing &= exchangeSerial(master, slave, badCommands[i], reply, sizeof(reply)) &&
+            strcmp(reply, "?") == 0;
+    }
+
+    // The bad commands must not have touched the time.
+    isPassing &= (CLOCK_SNAPSHOT_HOURS_BCD(getClockSnapshot()) == 0x12);
+
+    bool isRefreshing = true;
+    for (uint8_t task = 0; task < TASK_COUNT; ++task)
+    {
+        isRefreshing &= (getTaskOverruns(task) == 0);
+    }
+    printf("%-27s %s\n", "no task overruns", isRefreshing ? "ok" : "FAIL");
+    isPassing &= isRefreshing;
+
+    printf("%s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}
+
+
+/**
+    Run the serial port through a pseudo terminal, or check it.
+*/
+static int runSerial(int argc, char** argv)
+{
+    if (argc > 0 && strcmp(argv[0], "check") == 0)
+    {
+        return runSerialCheck();
+    }
+    return runSerialTerminal();
+}
+
+
+#ifdef PROFILE
+
+/**
+    Run the diagnostic display through all of its pages, then report the
+    profiling figures it showed. Only delays and port accesses take time
+    on the host, so the cycle counts are lower bounds.
+*/
+static int runDiagnostics()
+{
+    static const char* const pointNames[PROFILE_POINT_COUNT] = {
+        [PROFILE_TICK]      = "system tick",
+        [PROFILE_BLANK]     = "blank digit",
+    };
+
+    // At night, so that the blanking interrupt runs.
+    setClockTime(21, 0, 0);
+    startDiagnostics();
+    runFirmwareUntil(hostCycles + DIAGNOSTIC_SECONDS * F_CPU);
+
+    bool isPassing = true;
+    for (uint8_t point = 0; point < PROFILE_POINT_COUNT; ++point)
+    {
+        uint32_t minimum;
+        uint32_t average;
+        uint32_t maximum;
+        getProfileCycles(point, &minimum, &average, &maximum);
+        isPassing &= (minimum <= average && average <= maximum);
+
+        printf("%-24s min %6lu   avg %6lu   max %6lu cycles\n",
+            pointNames[point], (unsigned long) minimum, (unsigned long) average, (unsigned long) maximum);
+    }
+
+    uint16_t refreshRate = getRefreshRate();
+    uint16_t loopRate = getLoopRate();
+    isPassing &= (refreshRate == DISPLAY_REFRESH_HZ && loopRate >= TICK_RATE_HZ);
+    printf("%-24s %6u Hz\n", "refresh rate", refreshRate);
+    printf("%-24s %6u per second\n", "main loop", loopRate);
+
+    printf("%s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}
+
+#define PROFILE_USAGE   " | profile"
+#else
+#define PROFILE_USAGE   ""
+#endif
+
+
+int main(int argc, char** argv)
+{
+    hostEraseEeprom();
+    setupFirmware();
+
+    const char* command = (argc > 1) ? argv[1] : "bench";
+    if (strcmp(command, "bench") == 0)
+    {
+        return runBenchmarks();
+    }
+    else if (strcmp(command, "emulate") == 0)
+    {
+        return runEmulator(argc - 2, argv + 2);
+    }
+    else if (strcmp(command, "trace") == 0)
+    {
+        return runTrace(argc - 2, argv + 2);
+    }
+    else if (strcmp(command, "power") == 0)
+    {
+        return runPowerProfile();
+    }
+    else if (strcmp(command, "calibrate") == 0)
+    {
+        return runCalibrationCheck();
+    }
+    else if (strcmp(command, "tasks") == 0)
+    {
+        return runTaskProfile();
+    }
+    else if (strcmp(command, "light") == 0)
+    {
+        return runLightCheck();
+    }
+    else if (strcmp(command, "serial") == 0)
+    {
+        return runSerial(argc - 2, argv + 2);
+    }
+    else if (strcmp(command, "drift") == 0)
+    {
+        return runDriftCheck(argc - 2, argv + 2);
+    }
+#ifdef PROFILE
+    else if (strcmp(command, "profile") == 0)
+    {
+        return runDiagnostics();
+    }
+#endif
+
+    fprintf(stderr, "usage: %s [bench | emulate [days] [script] | trace [prefix] | power | calibrate | tasks | light | serial [check] | drift [trace]" PROFILE_USAGE "]\n", argv[0]);
+    return 1;
+}
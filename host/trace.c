@@ -0,0 +1,271 @@
+/**
+    Shift register waveform trace recorder.
+
+    Every change to the shift register pins is timestamped with the
+    simulated cycle count into a ring buffer. The cycle count advances by
+    the firmware's busy-wait delays, port accesses and interrupt overhead,
+    so deltas reflect those costs but not other instructions in between.
+
+    The recorded trace is exported as VCD for any waveform viewer, and
+    replayed through a model of the shift register to measure the on-time,
+    duty cycle and refresh frequency of each digit.
+*/
+
+#include <stdio.h>
+
+#include "trace.h"
+#include "board.h"
+#include "firmware.h"
+#include "../src/io.h"
+#include "../src/clock.h"
+#include "../src/display.h"
+
+
+#define TRACE_CAPACITY          65536
+#define TRACE_WARMUP_SECONDS    1.0
+#define TRACE_SECONDS           0.2
+
+#define TRACE_PIN_MASK  (IO_PIN_SHIFT_DATA | IO_PIN_SHIFT_CLOCK | IO_PIN_SHIFT_LATCH | IO_PIN_SHIFT_CLEAR)
+
+
+typedef struct
+{
+    uint64_t cycle;
+    uint8_t pins;
+} TraceEntry;
+
+static TraceEntry entries[TRACE_CAPACITY];
+static size_t oldestEntry = 0;
+static size_t entryCount = 0;
+
+static bool isRecording = false;
+static uint8_t previousPins = 0;
+
+// Pin levels and cycle from just before the oldest recorded entry.
+static uint8_t initialPins = 0;
+static uint64_t initialCycle = 0;
+
+
+void tracePinsChanged(uint8_t pins)
+{
+    pins &= TRACE_PIN_MASK;
+    if (pins == previousPins)
+    {
+        return;
+    }
+    previousPins = pins;
+
+    if ( ! isRecording)
+    {
+        return;
+    }
+
+    if (entryCount == TRACE_CAPACITY)
+    {
+        initialPins = entries[oldestEntry].pins;
+        initialCycle = entries[oldestEntry].cycle;
+        oldestEntry = (oldestEntry + 1) % TRACE_CAPACITY;
+        entryCount--;
+    }
+
+    TraceEntry* entry = &entries[(oldestEntry + entryCount) % TRACE_CAPACITY];
+    entry->cycle = hostCycles;
+    entry->pins = pins;
+    entryCount++;
+}
+
+
+static void startRecording()
+{
+    oldestEntry = 0;
+    entryCount = 0;
+    initialPins = previousPins;
+    initialCycle = hostCycles;
+    isRecording = true;
+}
+
+
+static const TraceEntry* getEntry(size_t i)
+{
+    return &entries[(oldestEntry + i) % TRACE_CAPACITY];
+}
+
+
+/**
+    VCD signal identifiers and names.
+*/
+static const struct
+{
+    uint8_t pin;
+    char id;
+    const char* name;
+} vcdSignals[] = {
+    { IO_PIN_SHIFT_DATA,  'd', "SHIFT_DATA" },
+    { IO_PIN_SHIFT_CLOCK, 'c', "SHIFT_CLOCK" },
+    { IO_PIN_SHIFT_LATCH, 'l', "SHIFT_LATCH" },
+    { IO_PIN_SHIFT_CLEAR, 'r', "SHIFT_CLEAR" },
+};
+
+#define VCD_SIGNAL_COUNT    (sizeof(vcdSignals) / sizeof(vcdSignals[0]))
+
+
+static unsigned long long cyclesToNs(uint64_t cycles)
+{
+    return (unsigned long long) (cycles * (1000000000.0 / F_CPU));
+}
+
+
+static bool exportVcd(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    fprintf(file, "$version element clock host trace $end\n");
+    fprintf(file, "$timescale 1 ns $end\n");
+    fprintf(file, "$scope module clock $end\n");
+    for (size_t i = 0; i < VCD_SIGNAL_COUNT; ++i)
+    {
+        fprintf(file, "$var wire 1 %c %s $end\n", vcdSignals[i].id, vcdSignals[i].name);
+    }
+    fprintf(file, "$upscope $end\n");
+    fprintf(file, "$enddefinitions $end\n");
+
+    fprintf(file, "#0\n$dumpvars\n");
+    for (size_t i = 0; i < VCD_SIGNAL_COUNT; ++i)
+    {
+        fprintf(file, "%d%c\n", (initialPins & vcdSignals[i].pin) ? 1 : 0, vcdSignals[i].id);
+    }
+    fprintf(file, "$end\n");
+
+    uint8_t pins = initialPins;
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        const TraceEntry* entry = getEntry(i);
+        fprintf(file, "#%llu\n", cyclesToNs(entry->cycle - initialCycle));
+        for (size_t j = 0; j < VCD_SIGNAL_COUNT; ++j)
+        {
+            uint8_t pin = vcdSignals[j].pin;
+            if ((pins ^ entry->pins) & pin)
+            {
+                fprintf(file, "%d%c\n", (entry->pins & pin) ? 1 : 0, vcdSignals[j].id);
+            }
+        }
+        pins = entry->pins;
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+/**
+    Replay the trace through a shift register model and report the
+    display timing measured between latch pulses.
+*/
+static void analyzeTrace(const char* name)
+{
+    uint64_t litCycles[DISPLAY_DIGITS] = { 0 };
+    uint32_t litLatches[DISPLAY_DIGITS] = { 0 };
+    uint32_t latches = 0;
+
+    ShiftWord shiftStage = 0;
+    ShiftWord latchedWord = 0;
+    uint64_t firstLatchCycle = 0;
+    uint64_t previousLatchCycle = 0;
+    uint8_t pins = initialPins;
+
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        const TraceEntry* entry = getEntry(i);
+        uint8_t rising = entry->pins & ~pins;
+        pins = entry->pins;
+
+        if ( ! (pins & IO_PIN_SHIFT_CLEAR))
+        {
+            shiftStage = 0;
+        }
+        if (rising & IO_PIN_SHIFT_CLOCK)
+        {
+            shiftStage = ((shiftStage << 1) | ((pins & IO_PIN_SHIFT_DATA) ? 1 : 0)) & BOARD_CHAIN_MASK;
+        }
+        if ( ! (rising & IO_PIN_SHIFT_LATCH))
+        {
+            continue;
+        }
+
+        if (latches == 0)
+        {
+            firstLatchCycle = entry->cycle;
+        }
+        else if (isBoardWordLit(latchedWord) && getBoardWordDigit(latchedWord) < DISPLAY_DIGITS)
+        {
+            // The first word may have been partly shifted before the trace
+            // began, and select a digit the board doesn't have.
+            uint8_t digit = getBoardWordDigit(latchedWord);
+            litCycles[digit] += entry->cycle - previousLatchCycle;
+            litLatches[digit]++;
+        }
+
+        latchedWord = shiftStage;
+        previousLatchCycle = entry->cycle;
+        latches++;
+    }
+
+    double windowSeconds = (double) (previousLatchCycle - firstLatchCycle) / F_CPU;
+    if (latches < 2 || windowSeconds <= 0)
+    {
+        printf("%s: no display refreshes recorded\n", name);
+        return;
+    }
+
+    uint64_t totalLitCycles = 0;
+    printf("%s:\n", name);
+    for (uint8_t digit = 0; digit < DISPLAY_DIGITS; ++digit)
+    {
+        double onTimeUs = litLatches[digit] ? (double) litCycles[digit] / litLatches[digit] * (1e6 / F_CPU) : 0;
+        double duty = (double) litCycles[digit] / F_CPU / windowSeconds;
+        printf("    digit %u   on-time %8.1f us   duty %5.1f %%   refresh %6.1f Hz\n",
+            digit, onTimeUs, duty * 100, litLatches[digit] / windowSeconds);
+        totalLitCycles += litCycles[digit];
+    }
+    printf("    display lit %5.1f %% of the time, %u latches in %.0f ms\n",
+        (double) totalLitCycles / F_CPU / windowSeconds * 100, latches, windowSeconds * 1000);
+}
+
+
+static bool traceScenario(const char* name, uint8_t hours, const char* prefix)
+{
+    setClockTime(hours, 8, 0);
+    runFirmwareUntil(hostCycles + (uint64_t) (TRACE_WARMUP_SECONDS * F_CPU));
+
+    startRecording();
+    runFirmwareUntil(hostCycles + (uint64_t) (TRACE_SECONDS * F_CPU));
+    isRecording = false;
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s-%s.vcd", prefix, name);
+    if ( ! exportVcd(path))
+    {
+        return false;
+    }
+
+    analyzeTrace(name);
+    printf("    waveforms written to %s\n", path);
+    return true;
+}
+
+
+int runTrace(int argc, char** argv)
+{
+    const char* prefix = (argc > 0) ? argv[0] : "trace";
+
+    if ( ! traceScenario("day", 10, prefix) || ! traceScenario("night", 21, prefix))
+    {
+        return 1;
+    }
+    return 0;
+}
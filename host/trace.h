@@ -0,0 +1,19 @@
+/**
+    Shift register waveform trace recorder.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+
+/**
+    Record the shift register pins while the display refreshes, export the
+    waveforms as VCD and report the display timing.
+
+    @param argc     Number of arguments.
+    @param argv     Optional output path prefix for the VCD files.
+    @return         Zero on success.
+*/
+int runTrace(int argc, char** argv);
+
+#endif
@@ -0,0 +1,258 @@
+/**
+    Simulated serial terminal.
+
+    Works at the bit level on the simulated chip's pins, as a real terminal
+    would. Bytes sent to the firmware are driven onto its receive pin at the
+    exact baud rate, and its transmit pin is sampled in the middle of each
+    bit, so both the firmware's bit timing and its tolerance of the other
+    end's are exercised.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "uart.h"
+#include "hal_host.h"
+#include "firmware.h"
+#include "../src/serial.h"
+
+
+#define UART_BIT_CYCLES     ((double) F_CPU / SERIAL_BAUD)
+#define UART_BUFFER_SIZE    256
+
+
+typedef struct
+{
+    char data[UART_BUFFER_SIZE];
+    size_t head;
+    size_t count;
+} UartBuffer;
+
+static UartBuffer sendBuffer;
+static UartBuffer receiveBuffer;
+
+
+// Frame being driven onto the receive pin. Bit 0 is the start bit, bits 1
+// to 8 the data and bit 9 the stop bit.
+static bool isSending = false;
+static uint64_t sendFrameCycle;
+static uint8_t sendBit;
+static uint8_t sendByte;
+static uint64_t sentCycle = 0;
+
+// Frame being sampled from the transmit pin, which is ignored until it has
+// been seen idling high.
+static bool isTransmitIdleSeen = false;
+static bool previousTransmit = false;
+static bool isReceiving = false;
+static uint64_t receiveFrameCycle;
+static uint8_t receiveBit;
+static uint8_t receiveByte;
+
+
+static void pushBuffer(UartBuffer* buffer, char c)
+{
+    if (buffer->count < UART_BUFFER_SIZE)
+    {
+        buffer->data[(buffer->head + buffer->count) % UART_BUFFER_SIZE] = c;
+        buffer->count++;
+    }
+}
+
+
+static char popBuffer(UartBuffer* buffer)
+{
+    char c = buffer->data[buffer->head];
+    buffer->head = (buffer->head + 1) % UART_BUFFER_SIZE;
+    buffer->count--;
+    return c;
+}
+
+
+static uint64_t getSendBitCycle(uint8_t bit)
+{
+    return sendFrameCycle + (uint64_t) (bit * UART_BIT_CYCLES + 0.5);
+}
+
+
+static void startSendFrame(uint64_t cycle)
+{
+    isSending = true;
+    sendFrameCycle = cycle;
+    sendBit = 0;
+    sendByte = popBuffer(&sendBuffer);
+}
+
+
+/**
+    Drive every bit that has come due onto the receive pin.
+*/
+static void driveReceivePin()
+{
+    while (isSending && hostCycles >= getSendBitCycle(sendBit))
+    {
+        if (sendBit == 10)
+        {
+            sentCycle = getSendBitCycle(10);
+            isSending = false;
+            if (sendBuffer.count > 0)
+            {
+                startSendFrame(sentCycle);
+            }
+            continue;
+        }
+
+        bool isHigh = (sendBit == 0) ? false : (sendBit == 9) ? true : (sendByte >> (sendBit - 1)) & 0x01;
+        hostDrivePortBInputs(SERIAL_PIN_RX, isHigh);
+        sendBit++;
+    }
+}
+
+
+/**
+    Sample every bit of the frame being received that fell before a cycle,
+    at the level the transmit pin held until then.
+*/
+static void sampleTransmitPin(uint64_t cycle)
+{
+    while (isReceiving)
+    {
+        double sampleCycle = receiveFrameCycle + (receiveBit + 1.5) * UART_BIT_CYCLES;
+        if (sampleCycle >= cycle)
+        {
+            break;
+        }
+
+        if (receiveBit < 8)
+        {
+            receiveByte |= previousTransmit << receiveBit;
+            receiveBit++;
+            continue;
+        }
+
+        // A low stop bit is a framing error, and the byte is dropped.
+        if (previousTransmit)
+        {
+            pushBuffer(&receiveBuffer, receiveByte);
+        }
+        isReceiving = false;
+    }
+}
+
+
+void uartPinsChanged(uint8_t pins)
+{
+    bool isHigh = pins & SERIAL_PIN_TX;
+    if (isHigh == previousTransmit)
+    {
+        return;
+    }
+
+    sampleTransmitPin(hostCycles);
+    previousTransmit = isHigh;
+
+    if (isHigh)
+    {
+        isTransmitIdleSeen = true;
+    }
+    else if (isTransmitIdleSeen && ! isReceiving)
+    {
+        isReceiving = true;
+        receiveFrameCycle = hostCycles;
+        receiveBit = 0;
+        receiveByte = 0;
+    }
+}
+
+
+void uartWrite(const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        pushBuffer(&sendBuffer, data[i]);
+    }
+
+    if ( ! isSending && sendBuffer.count > 0)
+    {
+        startSendFrame(hostCycles);
+    }
+}
+
+
+size_t uartRead(char* buffer, size_t size)
+{
+    size_t count = 0;
+    while (count < size && receiveBuffer.count > 0)
+    {
+        buffer[count++] = popBuffer(&receiveBuffer);
+    }
+    return count;
+}
+
+
+uint64_t getUartSentCycle()
+{
+    return sentCycle;
+}
+
+
+void runUartUntil(uint64_t endCycle)
+{
+    driveReceivePin();
+    while (hostCycles < endCycle)
+    {
+        uint64_t cycle = endCycle;
+        if (isSending && getSendBitCycle(sendBit) < cycle)
+        {
+            cycle = getSendBitCycle(sendBit);
+        }
+
+        runFirmwareUntil(cycle);
+        driveReceivePin();
+    }
+    sampleTransmitPin(hostCycles);
+}
+
+
+int openUartPty(const char** pName)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+        perror("pty");
+        return -1;
+    }
+
+    struct termios settings;
+    tcgetattr(fd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(fd, TCSANOW, &settings);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    *pName = ptsname(fd);
+    return fd;
+}
+
+
+void pumpUartPty(int fd)
+{
+    // Reads fail until the other side is first opened.
+    char buffer[64];
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length > 0)
+    {
+        uartWrite(buffer, length);
+    }
+
+    size_t count = uartRead(buffer, sizeof(buffer));
+    if (count > 0 && write(fd, buffer, count) < 0)
+    {
+        perror("pty");
+    }
+}
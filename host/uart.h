@@ -0,0 +1,64 @@
+/**
+    Simulated serial terminal.
+*/
+
+#ifndef UART_H
+#define UART_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+    Queue bytes to send to the firmware's serial port.
+
+    @param data     The bytes.
+    @param length   Number of bytes.
+*/
+void uartWrite(const char* data, size_t length);
+
+
+/**
+    Take bytes received from the firmware's serial port.
+
+    @param buffer   Filled with the bytes.
+    @param size     Size of the buffer.
+    @return         Number of bytes taken.
+*/
+size_t uartRead(char* buffer, size_t size);
+
+
+/**
+    Get the cycle at which the last byte finished sending, at the end of
+    its stop bit.
+*/
+uint64_t getUartSentCycle();
+
+
+/**
+    Run the firmware until a simulated cycle, driving the bits of queued
+    bytes onto its receive pin on time.
+
+    @param endCycle     The cycle to stop at.
+*/
+void runUartUntil(uint64_t endCycle);
+
+
+/**
+    Open a pseudo terminal to stand in for the serial port.
+
+    @param pName    Set to the path of the terminal for other programs to
+                    open.
+    @return         The non-blocking, raw master side, or -1 on failure.
+*/
+int openUartPty(const char** pName);
+
+
+/**
+    Move bytes between the pseudo terminal and the serial port.
+
+    @param fd   The master side.
+*/
+void pumpUartPty(int fd);
+
+#endif
@@ -0,0 +1,112 @@
+
+#include <stddef.h>
+
+#include "hal.h"
+#include "adc.h"
+
+#if defined(LIGHT_SENSOR) || defined(TEMPERATURE_COMPENSATION)
+
+
+/**
+    ADC clock prescaler.
+
+    The ADC clock must be between 50 and 200 kHz for full resolution.
+*/
+#if F_CPU / 8 <= 200000
+#define ADC_PRESCALE_BITS       ((1 << ADPS1) | (1 << ADPS0))
+#define ADC_PRESCALE            8
+#elif F_CPU / 64 <= 200000
+#define ADC_PRESCALE_BITS       ((1 << ADPS2) | (1 << ADPS1))
+#define ADC_PRESCALE            64
+#else
+#define ADC_PRESCALE_BITS       ((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0))
+#define ADC_PRESCALE            128
+#endif
+
+#if F_CPU / ADC_PRESCALE < 50000 || F_CPU / ADC_PRESCALE > 200000
+#error "No ADC prescaler gives a 50 to 200 kHz ADC clock at this F_CPU"
+#endif
+
+
+/**
+    Burst state.
+
+    The handler is set while a burst converts, and cleared once it has
+    completed. One more burst can wait behind it.
+*/
+volatile static AdcBurstHandler adcHandler = NULL;
+volatile static uint16_t adcBurstSum;
+volatile static uint8_t adcBurstCount;
+
+volatile static AdcBurstHandler adcWaitingHandler = NULL;
+volatile static uint8_t adcWaitingMux;
+
+
+void setupAdc()
+{
+    ADCSRA = (1 << ADEN) | (1 << ADIE) | ADC_PRESCALE_BITS;
+}
+
+
+static void startBurst(uint8_t mux, AdcBurstHandler handler)
+{
+    adcHandler = handler;
+    adcBurstSum = 0;
+    adcBurstCount = 0;
+    ADMUX = mux;
+    ADCSRA |= (1 << ADSC);
+}
+
+
+bool startAdcBurst(uint8_t mux, AdcBurstHandler handler)
+{
+    bool isStarted = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (adcHandler == NULL)
+        {
+            startBurst(mux, handler);
+            isStarted = true;
+        }
+        else if (adcHandler != handler && adcWaitingHandler == NULL)
+        {
+            adcWaitingHandler = handler;
+            adcWaitingMux = mux;
+            isStarted = true;
+        }
+    }
+    return isStarted;
+}
+
+
+ISR (ADC_vect)
+{
+    // The first conversion after switching the input or the reference may
+    // be off, so it is thrown away.
+    uint8_t count = adcBurstCount;
+    if (count != 0)
+    {
+        adcBurstSum += ADC;
+    }
+    adcBurstCount = ++count;
+    if (count <= ADC_OVERSAMPLES)
+    {
+        ADCSRA |= (1 << ADSC);
+        return;
+    }
+
+    // Start the waiting burst before handing over the reading, so that it
+    // converts meanwhile.
+    AdcBurstHandler handler = adcHandler;
+    uint16_t sum = adcBurstSum;
+    adcHandler = NULL;
+    if (adcWaitingHandler != NULL)
+    {
+        startBurst(adcWaitingMux, adcWaitingHandler);
+        adcWaitingHandler = NULL;
+    }
+
+    handler(sum);
+}
+
+#endif
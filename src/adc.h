@@ -0,0 +1,46 @@
+/**
+    Analog to digital converter.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**
+    Oversampling.
+
+    Each reading adds up ADC_OVERSAMPLES conversions, back to back, to
+    average out ADC noise.
+*/
+#define ADC_OVERSAMPLE_SHIFT    4
+#define ADC_OVERSAMPLES         (1 << ADC_OVERSAMPLE_SHIFT)
+
+
+/**
+    Called from the ADC interrupt when a burst completes.
+
+    @param sum  The sum of the burst's conversions.
+*/
+typedef void (*AdcBurstHandler)(uint16_t sum);
+
+
+/**
+    Setup the ADC, with its conversion complete interrupt.
+*/
+void setupAdc();
+
+
+/**
+    Start a burst of conversions, which completes in the background from
+    the ADC interrupt.
+
+    The ADC is shared by the sensors. A burst requested while another is
+    converting waits, and starts as soon as that one completes, so sensors
+    sampled on the same tick each get their reading.
+
+    @param mux      The ADMUX setting, selecting the input and reference.
+    @param handler  Called with the sum once the burst completes.
+    @return         False if a burst for the same handler is already
+                    converting or waiting, or another is already waiting.
+*/
+bool startAdcBurst(uint8_t mux, AdcBurstHandler handler);
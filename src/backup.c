@@ -0,0 +1,109 @@
+
+#include "hal.h"
+#include "clock.h"
+#include "backup.h"
+
+#ifdef TIME_BACKUP
+
+
+/**
+    Backup slots.
+
+    Each save goes to the slot after the previous one, spreading the wear
+    over the whole ring. With a save every minute each slot is written
+    every BACKUP_SLOT_COUNT minutes, so the EEPROM's 100,000 write cycles
+    last over eleven years.
+
+    Consecutive saves have consecutive sequence numbers, so the newest slot
+    is the one not followed by its successor. The check byte catches slots
+    left half written by a power failure, and erased slots.
+*/
+#define BACKUP_SLOT_COUNT   60
+
+typedef struct
+{
+    uint8_t sequence;
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t check;
+} BackupSlot;
+
+static BackupSlot EEMEM backupSlots[BACKUP_SLOT_COUNT];
+
+static uint8_t nextSlot = 0;
+static uint8_t nextSequence = 0;
+static uint8_t savedHours = 0xff;
+static uint8_t savedMinutes = 0xff;
+
+
+static uint8_t getSlotCheck(const BackupSlot* slot)
+{
+    return ~(slot->sequence + slot->hours + slot->minutes);
+}
+
+
+/**
+    Read a slot from EEPROM.
+
+    @return     True if the slot holds a valid time.
+*/
+static bool readSlot(uint8_t i, BackupSlot* slot)
+{
+    eeprom_read_block(slot, &backupSlots[i], sizeof(BackupSlot));
+    return slot->check == getSlotCheck(slot) && slot->hours < 24 && slot->minutes < 60;
+}
+
+
+bool restoreClockTime()
+{
+    for (uint8_t i = 0; i < BACKUP_SLOT_COUNT; ++i)
+    {
+        BackupSlot slot;
+        if ( ! readSlot(i, &slot))
+        {
+            continue;
+        }
+
+        uint8_t following = (i + 1) % BACKUP_SLOT_COUNT;
+        BackupSlot followingSlot;
+        if (readSlot(following, &followingSlot) && followingSlot.sequence == (uint8_t) (slot.sequence + 1))
+        {
+            continue;
+        }
+
+        nextSlot = following;
+        nextSequence = slot.sequence + 1;
+        savedHours = slot.hours;
+        savedMinutes = slot.minutes;
+        setClockTime(slot.hours, slot.minutes, 0);
+        return true;
+    }
+
+    return false;
+}
+
+
+void saveClockTime()
+{
+    uint32_t clockSnapshot = getClockSnapshot();
+
+    BackupSlot slot;
+    slot.hours = BCD_TO_BINARY(CLOCK_SNAPSHOT_HOURS_BCD(clockSnapshot));
+    slot.minutes = BCD_TO_BINARY(CLOCK_SNAPSHOT_MINUTES_BCD(clockSnapshot));
+
+    if (slot.hours == savedHours && slot.minutes == savedMinutes)
+    {
+        return;
+    }
+
+    slot.sequence = nextSequence;
+    slot.check = getSlotCheck(&slot);
+    eeprom_update_block(&slot, &backupSlots[nextSlot], sizeof(BackupSlot));
+
+    savedHours = slot.hours;
+    savedMinutes = slot.minutes;
+    nextSequence++;
+    nextSlot = (nextSlot + 1) % BACKUP_SLOT_COUNT;
+}
+
+#endif
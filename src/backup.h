@@ -0,0 +1,23 @@
+/**
+    Clock time backup.
+*/
+
+#include <stdbool.h>
+
+
+/**
+    Set the clock to the time most recently saved to EEPROM, if any.
+
+    @return     True if a saved time was found.
+*/
+bool restoreClockTime();
+
+
+/**
+    Save the clock time to EEPROM if it has changed minute since it was
+    last saved or restored.
+
+    Blocks while the EEPROM is written, so should be called from the main
+    loop rather than an interrupt handler.
+*/
+void saveClockTime();
@@ -0,0 +1,45 @@
+
+#include "hal.h"
+#include "light.h"
+#include "brightness.h"
+
+
+/**
+    Brightness level for each hour of the day.
+*/
+static const uint8_t brightnessSchedule[24] PROGMEM = {
+    BRIGHTNESS_MAX,     // 00:00
+    BRIGHTNESS_MAX,     // 01:00
+    BRIGHTNESS_MAX,     // 02:00
+    BRIGHTNESS_MAX,     // 03:00
+    BRIGHTNESS_MAX,     // 04:00
+    BRIGHTNESS_MAX,     // 05:00
+    BRIGHTNESS_MAX,     // 06:00
+    BRIGHTNESS_MAX,     // 07:00
+    BRIGHTNESS_MAX,     // 08:00
+    BRIGHTNESS_MAX,     // 09:00
+    BRIGHTNESS_MAX,     // 10:00
+    BRIGHTNESS_MAX,     // 11:00
+    BRIGHTNESS_MAX,     // 12:00
+    BRIGHTNESS_MAX,     // 13:00
+    BRIGHTNESS_MAX,     // 14:00
+    BRIGHTNESS_MAX,     // 15:00
+    BRIGHTNESS_MAX,     // 16:00
+    BRIGHTNESS_MAX,     // 17:00
+    BRIGHTNESS_MAX,     // 18:00
+    BRIGHTNESS_MAX,     // 19:00
+    0,                  // 20:00
+    0,                  // 21:00
+    0,                  // 22:00
+    0,                  // 23:00
+};
+
+
+uint8_t getTargetBrightness(uint8_t hours)
+{
+#ifdef BRIGHTNESS_LIGHT_SENSOR
+    return getAmbientBrightness();
+#else
+    return pgm_read_byte(brightnessSchedule + hours);
+#endif
+}
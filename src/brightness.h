@@ -0,0 +1,24 @@
+/**
+    Display brightness.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Number of display brightness levels.
+    Level 0 is the dimmest and BRIGHTNESS_MAX is fully on.
+*/
+#define BRIGHTNESS_LEVELS   8
+#define BRIGHTNESS_MAX      (BRIGHTNESS_LEVELS - 1)
+
+
+/**
+    Get the brightness level the display should have.
+
+    This follows the schedule for the time of day, or the room's light
+    level for boards built with BRIGHTNESS_LIGHT_SENSOR.
+
+    @param hours    The clock hours.
+*/
+uint8_t getTargetBrightness(uint8_t hours);
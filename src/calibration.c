@@ -0,0 +1,171 @@
+
+#include "hal.h"
+#include "io.h"
+#include "clock.h"
+#include "display.h"
+#include "timeset.h"
+#include "calibration.h"
+
+#ifdef OSCILLATOR_CALIBRATION
+
+
+/**
+    Calibration screen timing, in input samples.
+*/
+#define CALIBRATION_REPEAT_DELAY        (INPUT_SAMPLE_RATE_HZ / 2)      // half a second
+#define CALIBRATION_REPEAT_INTERVAL     (INPUT_SAMPLE_RATE_HZ / 20)     // 50 milliseconds
+#define CALIBRATION_SAVE_DELAY          (5 * INPUT_SAMPLE_RATE_HZ)      // 5 seconds
+
+#if CALIBRATION_REPEAT_INTERVAL < 1
+#error "INPUT_SAMPLE_RATE_HZ is too low for CALIBRATION_REPEAT_INTERVAL"
+#endif
+
+
+/**
+    Saved oscillator trim.
+
+    The trim is stored inverted, so that erased EEPROM reads as no trim.
+*/
+static uint16_t EEMEM calibrationStorage = 0xffff;
+
+
+void loadCalibration()
+{
+    int16_t trim = (int16_t) ~eeprom_read_word(&calibrationStorage);
+    if (trim < -CALIBRATION_TRIM_LIMIT || trim > CALIBRATION_TRIM_LIMIT)
+    {
+        trim = 0;
+    }
+    setClockTrim(trim);
+}
+
+
+/**
+    Show a trim as a sign and three digits.
+*/
+static void showTrim(int16_t trim)
+{
+    char text[4];
+    text[0] = (trim < 0) ? '-' : '+';
+    if (trim < 0)
+    {
+        trim = -trim;
+    }
+    text[1] = '0' + (trim / 100);
+    text[2] = '0' + ((trim / 10) % 10);
+    text[3] = '0' + (trim % 10);
+    showDisplayText(text);
+}
+
+
+/**
+    Calibration screen state.
+
+    The screen opens waiting for the button that opened it to be released,
+    since that press does not step the trim.
+*/
+typedef enum
+{
+    CALIBRATION_CLOSED,
+    CALIBRATION_OPENING,
+    CALIBRATION_OPEN,
+} CalibrationState;
+
+static CalibrationState calibrationState = CALIBRATION_CLOSED;
+static int16_t calibrationTrim = 0;
+static uint16_t heldSamples = 0;
+static uint16_t idleSamples = 0;
+
+
+void openCalibrationIfRequested()
+{
+    if ( ! isSpeedButtonPressed())
+    {
+        return;
+    }
+
+    // The button belongs to the calibration screen until it closes, so it
+    // doesn't also step the clock.
+    setTimeSetSuspended(true);
+
+    calibrationTrim = getClockTrim();
+    heldSamples = 0;
+    idleSamples = 0;
+    calibrationState = CALIBRATION_OPENING;
+    showTrim(calibrationTrim);
+}
+
+
+bool isCalibrationOpen()
+{
+    return calibrationState != CALIBRATION_CLOSED;
+}
+
+
+/**
+    Apply and save the trim, and go back to showing the time.
+*/
+static void closeCalibration()
+{
+    calibrationState = CALIBRATION_CLOSED;
+
+    setClockTrim(calibrationTrim);
+    eeprom_update_word(&calibrationStorage, (uint16_t) ~calibrationTrim);
+
+    showDisplayTime();
+    setTimeSetSuspended(false);
+}
+
+
+void updateCalibration()
+{
+    if (calibrationState == CALIBRATION_CLOSED)
+    {
+        return;
+    }
+
+    if ( ! isSpeedButtonPressed())
+    {
+        calibrationState = CALIBRATION_OPEN;
+        heldSamples = 0;
+        if (++idleSamples >= CALIBRATION_SAVE_DELAY)
+        {
+            closeCalibration();
+        }
+        return;
+    }
+
+    if (calibrationState == CALIBRATION_OPENING)
+    {
+        return;
+    }
+
+    idleSamples = 0;
+    bool shouldStep = (heldSamples == 0) ||
+        (heldSamples >= CALIBRATION_REPEAT_DELAY &&
+        (heldSamples - CALIBRATION_REPEAT_DELAY) % CALIBRATION_REPEAT_INTERVAL == 0);
+    heldSamples++;
+
+    if ( ! shouldStep)
+    {
+        return;
+    }
+
+    if (isElementModeSelected())
+    {
+        if (calibrationTrim > -CALIBRATION_TRIM_LIMIT)
+        {
+            calibrationTrim--;
+        }
+    }
+    else
+    {
+        if (calibrationTrim < CALIBRATION_TRIM_LIMIT)
+        {
+            calibrationTrim++;
+        }
+    }
+    showTrim(calibrationTrim);
+}
+
+#endif
@@ -0,0 +1,50 @@
+/**
+    Oscillator calibration.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**
+    Largest oscillator trim that can be set, in parts per million.
+*/
+#define CALIBRATION_TRIM_LIMIT  999
+
+
+/**
+    Apply the oscillator trim saved in EEPROM to the clock.
+*/
+void loadCalibration();
+
+
+/**
+    Open the calibration screen if the speed button is held at power up.
+
+    The display shows the oscillator trim in parts per million. Each press
+    of the speed button steps the trim by one, and holding it repeats. The
+    trim goes up with the mode switch on digits, and down with it on
+    elements. The trim is saved once the button has been left alone for a
+    few seconds. The clock and the background tasks keep running meanwhile,
+    and the speed button doesn't set the time until the screen closes.
+*/
+void openCalibrationIfRequested();
+
+
+/**
+    Check if the calibration screen is open.
+*/
+#ifdef OSCILLATOR_CALIBRATION
+bool isCalibrationOpen();
+#else
+#define isCalibrationOpen()     false
+#endif
+
+
+/**
+    Step the calibration screen from the input snapshot.
+
+    Scheduled as a background task at INPUT_SAMPLE_RATE_HZ, since closing
+    the screen writes the trim to EEPROM.
+*/
+void updateCalibration();
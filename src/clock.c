@@ -1,86 +1,301 @@
 
-#include <avr/interrupt.h>
-
-#include "io.h"
+#include "hal.h"
+#include "display.h"
+#include "tick.h"
+#include "clock.h"
+#include "calibration.h"
+#include "temperature.h"
 
 
 /**
     Timekeeping variables.
+
+    The time is kept in packed BCD, so that the display can take the
+    digits apart without dividing. The AVR has no divide instruction, while
+    converting BCD to binary only takes shifts and adds.
+*/
+volatile static uint8_t hoursBcd = 0x00;
+volatile static uint8_t minutesBcd = 0x00;
+volatile static uint8_t secondsBcd = 0x00;
+
+/**
+    Changed whenever the time is, so that readers can tell if the time
+    changed while they were reading it.
+*/
+volatile static uint8_t clockGeneration = 0;
+
+/**
+    System ticks since the current second began, and the same in units of
+    2^CLOCK_PHASE_SHIFT ticks for the snapshot phase.
+*/
+volatile static uint16_t clockTickCount = 0;
+volatile static uint8_t clockPhase = 0;
+
+#if TICK_RATE_HZ > (256 << CLOCK_PHASE_SHIFT)
+#error "TICK_RATE_HZ is too high for the snapshot phase"
+#endif
+
+static uint8_t bcdToBinary(uint8_t bcd)
+{
+    return BCD_TO_BINARY(bcd);
+}
+
+/**
+    Convert a value below 100 to BCD, without dividing.
+*/
+static uint8_t binaryToBcd(uint8_t n)
+{
+    uint8_t tens = 0;
+    while (n >= 10)
+    {
+        n -= 10;
+        tens++;
+    }
+    return (tens << 4) | n;
+}
+
+/**
+    Add one to a BCD value, carrying from the ones digit into the tens.
 */
-volatile static uint8_t hours = 0;
-volatile static uint8_t minutes = 0;
-volatile static uint8_t seconds = 0;
+static uint8_t incrementBcd(uint8_t bcd)
+{
+    bcd++;
+    if (BCD_ONES(bcd) == 10)
+    {
+        bcd += 0x10 - 10;
+    }
+    return bcd;
+}
 
 uint8_t getClockHours()
 {
-    return hours;
+    return bcdToBinary(hoursBcd);
 }
 
 uint8_t getClockMinutes()
 {
-    return minutes;
+    return bcdToBinary(minutesBcd);
+}
+
+
+uint32_t getClockSnapshot()
+{
+    uint8_t generation;
+    uint32_t snapshot;
+
+    // Retry if the time changed part way through. Interrupts stay enabled,
+    // and the time changes at most once a second, so this almost never
+    // loops.
+    do
+    {
+        generation = clockGeneration;
+        snapshot = ((uint32_t) hoursBcd << 24) | ((uint32_t) minutesBcd << 16) | ((uint16_t) secondsBcd << 8) | clockPhase;
+    }
+    while (generation != clockGeneration);
+
+    return snapshot;
+}
+
+
+void setClockTime(uint8_t newHours, uint8_t newMinutes, uint8_t newSeconds)
+{
+    uint8_t newHoursBcd = binaryToBcd(newHours);
+    uint8_t newMinutesBcd = binaryToBcd(newMinutes);
+    uint8_t newSecondsBcd = binaryToBcd(newSeconds);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        hoursBcd = newHoursBcd;
+        minutesBcd = newMinutesBcd;
+        secondsBcd = newSecondsBcd;
+
+        // Start the new second from this tick.
+        clockTickCount = 0;
+        clockPhase = 0;
+        clockGeneration++;
+    }
+    invalidateDisplay();
 }
 
 
+#ifdef CLOCK_TRIM
 /**
-    Clock timer CTC targets.
-    Count in increments of 64 microseconds.
+    Oscillator trim.
+
+    The trim is the oscillator error in parts per million, positive when it
+    runs fast. Each Timer1 count in a second is worth CLOCK_PPM_PER_COUNT,
+    so whole counts of trim lengthen every second, and the remainder is
+    accumulated so that occasional seconds are stretched by one more count.
+    A second's counts are spread over its first ticks, one count per tick,
+    so that the trim changes no refresh slot by more than a count.
+
+    The temperature compensation is another error on top of the trim, and
+    is applied the same way.
 */
-#define TIMER_COUNT_CLOCK        15625   // count 1.000 "seconds" per real second
-#define TIMER_COUNT_CLOCK_FAST   21      // count 12.40 "minutes" per real second
+#define CLOCK_COUNTS_PER_SECOND  (F_CPU / TICK_TIMER_PRESCALE)
+#define CLOCK_PPM_PER_COUNT      (1000000L / CLOCK_COUNTS_PER_SECOND)
+
+#if CLOCK_PPM_PER_COUNT * CLOCK_COUNTS_PER_SECOND != 1000000L
+#error "The Timer1 clock must divide 1 MHz for the oscillator trim"
+#endif
+
+// The largest trim and compensation, plus a count for the remainder, must
+// fit one count per tick.
+#if (CALIBRATION_TRIM_LIMIT + TEMPERATURE_CORRECTION_LIMIT) / CLOCK_PPM_PER_COUNT + 1 > TICK_RATE_HZ
+#error "TICK_RATE_HZ is too low to spread the oscillator trim"
+#endif
 
-void setupClockTimer()
+volatile static int16_t clockTrim = 0;
+volatile static int16_t clockCompensation = 0;
+volatile static int16_t clockTrimCounts = 0;
+volatile static uint8_t clockTrimFraction = 0;
+
+int16_t getClockTrim()
 {
-    TCCR1B |= (1 << WGM12);               // Configure Timer1 for CTC mode
-    TCCR1B |= (1 << CS11) | (1 << CS10);  // Divide the timer clock by 64
-    TIMSK1 |= (1 << OCIE1A);              // Enable the CTC match interrupt
-    OCR1A = TIMER_COUNT_CLOCK;
+    return clockTrim;
 }
 
-ISR (TIM1_COMPA_vect)
+int16_t getClockCompensation()
 {
-    seconds++;
-    if (seconds >= 60)
+    return clockCompensation;
+}
+
+/**
+    Apply the trim and the temperature compensation together.
+*/
+static void applyClockTrim(int16_t trim, int16_t compensation)
+{
+    int16_t error = trim + compensation;
+
+    // Round towards negative infinity, so the fraction is never negative.
+    int16_t wholeCounts = error / CLOCK_PPM_PER_COUNT;
+    int16_t fraction = error % CLOCK_PPM_PER_COUNT;
+    if (fraction < 0)
     {
-        minutes++;
-        seconds = 0;
+        wholeCounts--;
+        fraction += CLOCK_PPM_PER_COUNT;
     }
 
-    if (minutes >= 60)
+    // Takes effect from the next second.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        hours++;
-        minutes = 0;
+        clockTrim = trim;
+        clockCompensation = compensation;
+        clockTrimCounts = wholeCounts;
+        clockTrimFraction = fraction;
     }
+}
+
+void setClockTrim(int16_t trim)
+{
+    applyClockTrim(trim, clockCompensation);
+}
 
-    if (hours >= 24)
+void setClockCompensation(int16_t compensation)
+{
+    applyClockTrim(clockTrim, compensation);
+}
+#endif
+
+
+void advanceClockTime(uint16_t advanceMinutes)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        hours = 0;
+        uint16_t newMinutes = bcdToBinary(minutesBcd) + advanceMinutes;
+        uint8_t newHours = bcdToBinary(hoursBcd);
+        while (newMinutes >= 60)
+        {
+            newMinutes -= 60;
+            newHours++;
+        }
+        while (newHours >= 24)
+        {
+            newHours -= 24;
+        }
+
+        hoursBcd = binaryToBcd(newHours);
+        minutesBcd = binaryToBcd(newMinutes);
+        secondsBcd = 0x00;
+
+        // Start the new minute from this tick.
+        clockTickCount = 0;
+        clockPhase = 0;
+        clockGeneration++;
     }
+    invalidateDisplay();
 }
 
 
+/**
+    Count one second.
+*/
+static void incrementClockTime()
+{
+    clockGeneration++;
 
-void clockCheckSpeedMode()
+    secondsBcd = incrementBcd(secondsBcd);
+#if DISPLAY_DIGITS >= 6
+    invalidateDisplay();
+#endif
+    if (secondsBcd == 0x60)
+    {
+        secondsBcd = 0x00;
+        minutesBcd = incrementBcd(minutesBcd);
+        invalidateDisplay();
+
+        if (minutesBcd == 0x60)
+        {
+            minutesBcd = 0x00;
+            hoursBcd = incrementBcd(hoursBcd);
+
+            if (hoursBcd == 0x24)
+            {
+                hoursBcd = 0x00;
+            }
+        }
+    }
+}
+
+
+int8_t countClockTick()
 {
-    static bool wasPreviouslyFastMode = false;
-    bool isCurrentlySpeedMode = isSpeedButtonPressed();
+#ifdef CLOCK_TRIM
+    static int16_t trimCounts = 0;
+    static uint8_t trimAccumulator = 0;
+#endif
 
-    // Reset the timer when switching to TIMER_COUNT_CLOCK_FAST, because if
-    // TCNT1 > TIMER_COUNT_CLOCK_FAST at the time then it will miss the CTC
-    // match and result in a ~4 second delay.
-    if (isCurrentlySpeedMode && ! wasPreviouslyFastMode)
+    clockTickCount++;
+    if (clockTickCount >= TICK_RATE_HZ)
     {
-        TCNT1 = 0;
+        clockTickCount = 0;
+        incrementClockTime();
+
+#ifdef CLOCK_TRIM
+        // Stretch this second by one more count whenever the accumulated
+        // fractional trim passes a whole count.
+        trimCounts = clockTrimCounts;
+        trimAccumulator += clockTrimFraction;
+        if (trimAccumulator >= CLOCK_PPM_PER_COUNT)
+        {
+            trimAccumulator -= CLOCK_PPM_PER_COUNT;
+            trimCounts++;
+        }
+#endif
     }
+    clockPhase = clockTickCount >> CLOCK_PHASE_SHIFT;
 
-    if (isCurrentlySpeedMode)
+#ifdef CLOCK_TRIM
+    if (trimCounts > 0)
     {
-        OCR1A = TIMER_COUNT_CLOCK_FAST;
+        trimCounts--;
+        return 1;
     }
-    else
+    else if (trimCounts < 0)
     {
-        OCR1A = TIMER_COUNT_CLOCK;
+        trimCounts++;
+        return -1;
     }
-
-    wasPreviouslyFastMode = isCurrentlySpeedMode;
+#endif
+    return 0;
 }
@@ -8,11 +8,20 @@
     @date   August 13, 2016
 */
 
+#include <stdint.h>
+
+#include "tick.h"
+
 
 /**
-    Setup the real time clock timer.
+    Count one system tick, counting a second every TICK_RATE_HZ ticks.
+
+    Called from the system tick interrupt.
+
+    @return     Timer1 counts to add to the next tick period, applying the
+                oscillator trim.
 */
-void setupClockTimer();
+int8_t countClockTick();
 
 
 /**
@@ -28,6 +37,113 @@ uint8_t getClockHours();
 
 
 /**
-    Set the timer CTC count based on the selected timer mode.
+    Get the current real-time clock time as one consistent value.
+
+    Unlike calling the separate getters, the fields can't be torn by a
+    clock tick between reads, such as showing the new minutes with the old
+    hour. Interrupts are not disabled while reading.
+
+    @return     The time, taken apart with the CLOCK_SNAPSHOT_ macros.
+*/
+uint32_t getClockSnapshot();
+
+
+/**
+    Fields of a clock snapshot.
+
+    The hours, minutes and seconds are packed BCD, with the tens digit in
+    the high nibble. The phase is the time
+    since the second began, in units of 2^CLOCK_PHASE_SHIFT system ticks
+    (4 ms at the default tick rate), so runs from 0 up to 249. Faster ticks
+    take a larger unit, so the phase always fits in a byte.
 */
-void clockCheckSpeedMode();
+#if TICK_RATE_HZ > 512
+#define CLOCK_PHASE_SHIFT                       2
+#else
+#define CLOCK_PHASE_SHIFT                       1
+#endif
+
+#define CLOCK_SNAPSHOT_HOURS_BCD(snapshot)      ((uint8_t) ((snapshot) >> 24))
+#define CLOCK_SNAPSHOT_MINUTES_BCD(snapshot)    ((uint8_t) ((snapshot) >> 16))
+#define CLOCK_SNAPSHOT_SECONDS_BCD(snapshot)    ((uint8_t) ((snapshot) >> 8))
+#define CLOCK_SNAPSHOT_PHASE(snapshot)          ((uint8_t) (snapshot))
+
+
+/**
+    Digits of a packed BCD value.
+*/
+#define BCD_TENS(bcd)   ((uint8_t) (bcd) >> 4)
+#define BCD_ONES(bcd)   ((uint8_t) (bcd) & 0x0f)
+#define BCD_TO_BINARY(bcd)  (BCD_TENS(bcd) * 10 + BCD_ONES(bcd))
+
+
+/**
+    Set the real-time clock time.
+
+    The new second starts from the call, so the clock can be set in step
+    with another.
+
+    @param newHours     Hours, 0 to 23.
+    @param newMinutes   Minutes, 0 to 59.
+    @param newSeconds   Seconds, 0 to 59.
+*/
+void setClockTime(uint8_t newHours, uint8_t newMinutes, uint8_t newSeconds);
+
+
+/**
+    Move the clock forward, as when setting the time.
+
+    The seconds are cleared and the new minute starts from the call.
+
+    @param advanceMinutes   Minutes to move forward by, wrapping at midnight.
+*/
+void advanceClockTime(uint16_t advanceMinutes);
+
+
+/**
+    The clock is only trimmed in builds with the calibration screen or
+    temperature compensation, which are the only ones to set a trim.
+*/
+#if defined(OSCILLATOR_CALIBRATION) || defined(TEMPERATURE_COMPENSATION)
+#define CLOCK_TRIM
+#endif
+
+
+/**
+    Get the oscillator trim.
+
+    @return     The oscillator error in parts per million, positive when it
+                runs fast.
+*/
+int16_t getClockTrim();
+
+
+/**
+    Set the oscillator trim, correcting the clock for a known error in the
+    oscillator frequency.
+
+    @param trim     The oscillator error in parts per million, positive when
+                    it runs fast.
+*/
+void setClockTrim(int16_t trim);
+
+
+/**
+    Get the temperature compensation.
+
+    @return     The oscillator error at the current temperature in parts
+                per million, positive when it runs fast.
+*/
+int16_t getClockCompensation();
+
+
+/**
+    Set the temperature compensation, correcting the clock for the
+    oscillator's error at the current temperature on top of the trim.
+
+    @param compensation     The oscillator error at the current temperature
+                            in parts per million, positive when it runs
+                            fast.
+*/
+void setClockCompensation(int16_t compensation);
+
@@ -0,0 +1,34 @@
+
+#include "hal.h"
+#include "decimal.h"
+
+#if defined(SERIAL_PORT) || defined(PROFILE)
+
+
+uint8_t formatDecimal(uint32_t n, char* text)
+{
+    static const uint32_t placeValues[DECIMAL_DIGITS_MAX] PROGMEM = {
+        1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1,
+    };
+
+    uint8_t length = 0;
+    for (uint8_t i = 0; i < DECIMAL_DIGITS_MAX; ++i)
+    {
+        uint32_t placeValue = pgm_read_dword(placeValues + i);
+        char digit = '0';
+        while (n >= placeValue)
+        {
+            n -= placeValue;
+            digit++;
+        }
+
+        // The ones digit is always included.
+        if (length != 0 || digit != '0' || placeValue == 1)
+        {
+            text[length++] = digit;
+        }
+    }
+    return length;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/**
+    Decimal formatting, for the serial port and the diagnostic display.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Most digits a number can format to.
+*/
+#define DECIMAL_DIGITS_MAX  10
+
+
+/**
+    Format a number in decimal, without dividing.
+
+    @param n        The number.
+    @param text     Set to the digits, most significant first, without
+                    leading zeros or a terminator. Room for
+                    DECIMAL_DIGITS_MAX characters is needed.
+    @return         The number of digits.
+*/
+uint8_t formatDecimal(uint32_t n, char* text);
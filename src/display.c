@@ -2,179 +2,203 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
-#include <util/delay.h>
-
+#include "hal.h"
 #include "io.h"
 #include "clock.h"
+#include "brightness.h"
+#include "tick.h"
+#include "profile.h"
 
 
 /**
-    Font segment and digit select bit indexes.
+    Shift register wiring.
 
     Each display LED segment is mapped to a specific pin on the combined
-    shift register, as are the digit select bits.
+    shift register, as are the digit select bits. Bits are numbered in
+    shift order, so bit IO_SHIFT_BITS - 1 is shifted in first and bit 0
+    last. Rewiring a board only requires changing this map.
+
+    The segments all sit in the first two registers, so glyphs fit in 16
+    bits whatever the chain length. The digit select bits are a binary
+    digit number for a decoder, so boards of more than 4 digits take a
+    third select bit, from a third register.
 */
-enum
-{
-    SEG_A = (1 << 0),
-    SEG_B = (1 << 1),
-    SEG_C = (1 << 2),
-    SEG_D = (1 << 3),
-    SEG_E = (1 << 4),
-    SEG_F = (1 << 5),
-    SEG_G = (1 << 6),
-    SEG_H = (1 << 7),
-    SEG_J = (1 << 8),
-    SEG_K = (1 << 9),
-    SEG_L = (1 << 10),
-    SEG_M = (1 << 11),
-    SEG_N = (1 << 12),
-    SEG_P = (1 << 13),
-
-    EMPTY_GLYPH     = (0),
-    UNDEFINED_GLYPH = (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G | SEG_H | SEG_J | SEG_K | SEG_L | SEG_M | SEG_N | SEG_P),
-};
+#define SEG_A               (1u << 2)
+#define SEG_B               (1u << 1)
+#define SEG_C               (1u << 8)
+#define SEG_D               (1u << 9)
+#define SEG_E               (1u << 14)
+#define SEG_F               (1u << 7)
+#define SEG_G               (1u << 5)
+#define SEG_H               (1u << 4)
+#define SEG_J               (1u << 10)
+#define SEG_K               (1u << 11)
+#define SEG_L               (1u << 12)
+#define SEG_M               (1u << 13)
+#define SEG_N               (1u << 3)
+#define SEG_P               (1u << 6)
+
+#define DIGIT_SELECT_1      ((ShiftWord) 1 << 0)
+#define DIGIT_SELECT_2      ((ShiftWord) 1 << 15)
+#if DISPLAY_DIGITS > 4
+#define DIGIT_SELECT_3      ((ShiftWord) 1 << 16)
+#endif
+
+#if DISPLAY_DIGITS > 4 && IO_SHIFT_BITS < 24
+#error "DISPLAY_DIGITS over 4 needs a third digit select bit, with IO_SHIFT_BITS of 24 or 32"
+#endif
+
+#define EMPTY_GLYPH         (0)
+#define UNDEFINED_GLYPH     (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G | SEG_H | SEG_J | SEG_K | SEG_L | SEG_M | SEG_N | SEG_P)
+
+
+/**
+    Encode a glyph as it is shifted out.
+
+    The segment outputs are active low, so glyphs are stored inverted.
+    The digit select bits are left clear to be filled in per digit.
+*/
+#define GLYPH(segments)     ((uint16_t) (~(segments) & UNDEFINED_GLYPH))
 
 
 /**
     Font data for all printable ASCII characters.
 
     All printable characters are supported, though some more than others.
+    Glyphs are stored ready to shift out, see GLYPH().
 */
 static const uint16_t displayFont[] PROGMEM = {
-    UNDEFINED_GLYPH,                                                     // NUL
-    UNDEFINED_GLYPH,                                                     // SOH
-    UNDEFINED_GLYPH,                                                     // STX
-    UNDEFINED_GLYPH,                                                     // ETX
-    UNDEFINED_GLYPH,                                                     // EOT
-    UNDEFINED_GLYPH,                                                     // ENQ
-    UNDEFINED_GLYPH,                                                     // ACK
-    UNDEFINED_GLYPH,                                                     // BEL
-    UNDEFINED_GLYPH,                                                     // BS
-    UNDEFINED_GLYPH,                                                     // TAB
-    UNDEFINED_GLYPH,                                                     // LF
-    UNDEFINED_GLYPH,                                                     // VT
-    UNDEFINED_GLYPH,                                                     // FF
-    UNDEFINED_GLYPH,                                                     // CR
-    UNDEFINED_GLYPH,                                                     // SO
-    UNDEFINED_GLYPH,                                                     // SI
-    UNDEFINED_GLYPH,                                                     // DLE
-    UNDEFINED_GLYPH,                                                     // DC1
-    UNDEFINED_GLYPH,                                                     // DC2
-    UNDEFINED_GLYPH,                                                     // DC3
-    UNDEFINED_GLYPH,                                                     // DC4
-    UNDEFINED_GLYPH,                                                     // NAK
-    UNDEFINED_GLYPH,                                                     // SYN
-    UNDEFINED_GLYPH,                                                     // ETB
-    UNDEFINED_GLYPH,                                                     // CAN
-    UNDEFINED_GLYPH,                                                     // EM
-    UNDEFINED_GLYPH,                                                     // SUB
-    UNDEFINED_GLYPH,                                                     // ESC
-    UNDEFINED_GLYPH,                                                     // FS
-    UNDEFINED_GLYPH,                                                     // GS
-    UNDEFINED_GLYPH,                                                     // RS
-    UNDEFINED_GLYPH,                                                     // US
-
-    EMPTY_GLYPH,                                                         // <space>
-    (SEG_E | SEG_F),                                                     // !
-    (SEG_G | SEG_H),                                                     // "
-    (SEG_B | SEG_C | SEG_D | SEG_N | SEG_J | SEG_G | SEG_H),             // #
-    (SEG_A | SEG_F | SEG_N | SEG_J | SEG_C | SEG_D | SEG_G | SEG_L),     // $
-    (SEG_F | SEG_M | SEG_H | SEG_C),                                     // %
-    (SEG_A | SEG_H | SEG_N | SEG_E | SEG_D | SEG_K | SEG_P),             // &
-    (SEG_H),                                                             // '
-    (SEG_A | SEG_F | SEG_E | SEG_D),                                     // (
-    (SEG_A | SEG_B | SEG_C | SEG_D),                                     // )
-    (SEG_P | SEG_G | SEG_H | SEG_M | SEG_L | SEG_K),                     // *
-    (SEG_G | SEG_L | SEG_N | SEG_J),                                     // +
-    (SEG_M),                                                             // ,
-    (SEG_N | SEG_J),                                                     // -
-    (SEG_K),                                                             // .
-    (SEG_M | SEG_H),                                                     // /
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_M | SEG_H),     // 0
-    (SEG_B | SEG_C | SEG_H),                                             // 1
-    (SEG_A | SEG_B | SEG_D | SEG_E | SEG_N | SEG_J),                     // 2
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_J),                             // 3
-    (SEG_B | SEG_C | SEG_F | SEG_N | SEG_J),                             // 4
-    (SEG_A | SEG_C | SEG_D | SEG_F | SEG_N | SEG_J),                     // 5
-    (SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),             // 6
-    (SEG_A | SEG_H | SEG_L),                                             // 7
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),     // 8
-    (SEG_A | SEG_B | SEG_C | SEG_F | SEG_N | SEG_J),                     // 9
-    (SEG_F | SEG_E),                                                     // :
-    (SEG_F | SEG_E),                                                     // ;
-    (SEG_H | SEG_K),                                                     // <
-    (SEG_A | SEG_D),                                                     // =
-    (SEG_P | SEG_M),                                                     // >
-    (SEG_F | SEG_A | SEG_H | SEG_L | SEG_D),                             // ?
-
-    (SEG_L | SEG_K | SEG_C | SEG_B | SEG_J | SEG_A),                     // @
-    (SEG_A | SEG_B | SEG_C | SEG_E | SEG_F | SEG_N | SEG_J),             // A
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_G | SEG_L | SEG_J),             // B
-    (SEG_A | SEG_D | SEG_E | SEG_F),                                     // C
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_G | SEG_L),                     // D
-    (SEG_A | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),                     // E
-    (SEG_A | SEG_E | SEG_F | SEG_N | SEG_J),                             // F
-    (SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_J),                     // G
-    (SEG_B | SEG_C | SEG_E | SEG_F | SEG_N | SEG_J),                     // H
-    (SEG_A | SEG_D | SEG_G | SEG_L),                                     // I
-    (SEG_B | SEG_C | SEG_D | SEG_E),                                     // J
-    (SEG_H | SEG_K | SEG_E | SEG_F | SEG_N),                             // K
-    (SEG_D | SEG_E | SEG_F),                                             // L
-    (SEG_H | SEG_B | SEG_C | SEG_E | SEG_F | SEG_P),                     // M
-    (SEG_B | SEG_C | SEG_E | SEG_F | SEG_P | SEG_K),                     // N
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),                     // O
-    (SEG_A | SEG_B | SEG_E | SEG_F | SEG_N | SEG_J),                     // P
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_K),             // Q
-    (SEG_A | SEG_B | SEG_K | SEG_E | SEG_F | SEG_N | SEG_J),             // R
-    (SEG_A | SEG_P | SEG_J | SEG_C | SEG_D),                             // S
-    (SEG_A | SEG_G | SEG_L),                                             // T
-    (SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),                             // U
-    (SEG_H | SEG_M | SEG_F | SEG_E),                                     // V
-    (SEG_B | SEG_C | SEG_K | SEG_M | SEG_E | SEG_F),                     // W
-    (SEG_P | SEG_H | SEG_M | SEG_K),                                     // X
-    (SEG_P | SEG_H | SEG_L),                                             // Y
-    (SEG_A | SEG_H | SEG_M | SEG_D),                                     // Z
-    (SEG_A | SEG_F | SEG_E | SEG_D),                                     // [
-    (SEG_P | SEG_K),                                                     // \              :)
-    (SEG_A | SEG_B | SEG_C | SEG_D),                                     // ]
-    (SEG_G | SEG_A | SEG_B),                                             // ^
-    (SEG_D),                                                             // _
-
-    (SEG_P),                                                             // `
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_N | SEG_J),             // a
-    (SEG_F | SEG_E | SEG_D | SEG_N | SEG_K),                             // b
-    (SEG_N | SEG_J | SEG_E | SEG_D),                                     // c
-    (SEG_B | SEG_C | SEG_D | SEG_M | SEG_J),                             // d
-    (SEG_N | SEG_E | SEG_M | SEG_D),                                     // e
-    (SEG_A | SEG_F | SEG_E | SEG_N),                                     // f
-    (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_P | SEG_J),             // g
-    (SEG_F | SEG_E | SEG_N | SEG_J | SEG_C),                             // h
-    (SEG_L),                                                             // i
-    (SEG_B | SEG_C | SEG_D),                                             // j
-    (SEG_G | SEG_L | SEG_K | SEG_H),                                     // k
-    (SEG_G | SEG_L),                                                     // l
-    (SEG_E | SEG_L | SEG_C | SEG_N | SEG_J),                             // m
-    (SEG_E | SEG_N | SEG_K),                                             // n
-    (SEG_N | SEG_J | SEG_C | SEG_D | SEG_E),                             // o
-    (SEG_A | SEG_F | SEG_E | SEG_N | SEG_H),                             // p
-    (SEG_A | SEG_B | SEG_N | SEG_J | SEG_F | SEG_K),                     // q
-    (SEG_E | SEG_N),                                                     // r
-    (SEG_A | SEG_P | SEG_J | SEG_C | SEG_D),                             // s
-    (SEG_F | SEG_E | SEG_D | SEG_N),                                     // t
-    (SEG_E | SEG_D | SEG_C),                                             // u
-    (SEG_E | SEG_M),                                                     // v
-    (SEG_E | SEG_M | SEG_K | SEG_C),                                     // w
-    (SEG_P | SEG_H | SEG_M | SEG_K),                                     // x
-    (SEG_G | SEG_B | SEG_J | SEG_C | SEG_D),                             // y
-    (SEG_A | SEG_H | SEG_M | SEG_D),                                     // z
-    (SEG_A | SEG_P | SEG_N | SEG_M | SEG_D),                             // {
-    (SEG_G | SEG_L),                                                     // |
-    (SEG_A | SEG_H | SEG_J | SEG_K | SEG_D),                             // }
-    (SEG_M | SEG_J),                                                     // ~
-    UNDEFINED_GLYPH,                                                     // DEL
+    GLYPH(UNDEFINED_GLYPH),                                              // NUL
+    GLYPH(UNDEFINED_GLYPH),                                              // SOH
+    GLYPH(UNDEFINED_GLYPH),                                              // STX
+    GLYPH(UNDEFINED_GLYPH),                                              // ETX
+    GLYPH(UNDEFINED_GLYPH),                                              // EOT
+    GLYPH(UNDEFINED_GLYPH),                                              // ENQ
+    GLYPH(UNDEFINED_GLYPH),                                              // ACK
+    GLYPH(UNDEFINED_GLYPH),                                              // BEL
+    GLYPH(UNDEFINED_GLYPH),                                              // BS
+    GLYPH(UNDEFINED_GLYPH),                                              // TAB
+    GLYPH(UNDEFINED_GLYPH),                                              // LF
+    GLYPH(UNDEFINED_GLYPH),                                              // VT
+    GLYPH(UNDEFINED_GLYPH),                                              // FF
+    GLYPH(UNDEFINED_GLYPH),                                              // CR
+    GLYPH(UNDEFINED_GLYPH),                                              // SO
+    GLYPH(UNDEFINED_GLYPH),                                              // SI
+    GLYPH(UNDEFINED_GLYPH),                                              // DLE
+    GLYPH(UNDEFINED_GLYPH),                                              // DC1
+    GLYPH(UNDEFINED_GLYPH),                                              // DC2
+    GLYPH(UNDEFINED_GLYPH),                                              // DC3
+    GLYPH(UNDEFINED_GLYPH),                                              // DC4
+    GLYPH(UNDEFINED_GLYPH),                                              // NAK
+    GLYPH(UNDEFINED_GLYPH),                                              // SYN
+    GLYPH(UNDEFINED_GLYPH),                                              // ETB
+    GLYPH(UNDEFINED_GLYPH),                                              // CAN
+    GLYPH(UNDEFINED_GLYPH),                                              // EM
+    GLYPH(UNDEFINED_GLYPH),                                              // SUB
+    GLYPH(UNDEFINED_GLYPH),                                              // ESC
+    GLYPH(UNDEFINED_GLYPH),                                              // FS
+    GLYPH(UNDEFINED_GLYPH),                                              // GS
+    GLYPH(UNDEFINED_GLYPH),                                              // RS
+    GLYPH(UNDEFINED_GLYPH),                                              // US
+
+    GLYPH(EMPTY_GLYPH),                                                  // <space>
+    GLYPH(SEG_E | SEG_F),                                                // !
+    GLYPH(SEG_G | SEG_H),                                                // "
+    GLYPH(SEG_B | SEG_C | SEG_D | SEG_N | SEG_J | SEG_G | SEG_H),        // #
+    GLYPH(SEG_A | SEG_F | SEG_N | SEG_J | SEG_C | SEG_D | SEG_G | SEG_L),// $
+    GLYPH(SEG_F | SEG_M | SEG_H | SEG_C),                                // %
+    GLYPH(SEG_A | SEG_H | SEG_N | SEG_E | SEG_D | SEG_K | SEG_P),        // &
+    GLYPH(SEG_H),                                                        // '
+    GLYPH(SEG_A | SEG_F | SEG_E | SEG_D),                                // (
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D),                                // )
+    GLYPH(SEG_P | SEG_G | SEG_H | SEG_M | SEG_L | SEG_K),                // *
+    GLYPH(SEG_G | SEG_L | SEG_N | SEG_J),                                // +
+    GLYPH(SEG_M),                                                        // ,
+    GLYPH(SEG_N | SEG_J),                                                // -
+    GLYPH(SEG_K),                                                        // .
+    GLYPH(SEG_M | SEG_H),                                                // /
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_M | SEG_H),// 0
+    GLYPH(SEG_B | SEG_C | SEG_H),                                        // 1
+    GLYPH(SEG_A | SEG_B | SEG_D | SEG_E | SEG_N | SEG_J),                // 2
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_J),                        // 3
+    GLYPH(SEG_B | SEG_C | SEG_F | SEG_N | SEG_J),                        // 4
+    GLYPH(SEG_A | SEG_C | SEG_D | SEG_F | SEG_N | SEG_J),                // 5
+    GLYPH(SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),        // 6
+    GLYPH(SEG_A | SEG_H | SEG_L),                                        // 7
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),// 8
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_F | SEG_N | SEG_J),                // 9
+    GLYPH(SEG_F | SEG_E),                                                // :
+    GLYPH(SEG_F | SEG_E),                                                // ;
+    GLYPH(SEG_H | SEG_K),                                                // <
+    GLYPH(SEG_A | SEG_D),                                                // =
+    GLYPH(SEG_P | SEG_M),                                                // >
+    GLYPH(SEG_F | SEG_A | SEG_H | SEG_L | SEG_D),                        // ?
+
+    GLYPH(SEG_L | SEG_K | SEG_C | SEG_B | SEG_J | SEG_A),                // @
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_E | SEG_F | SEG_N | SEG_J),        // A
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_G | SEG_L | SEG_J),        // B
+    GLYPH(SEG_A | SEG_D | SEG_E | SEG_F),                                // C
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_G | SEG_L),                // D
+    GLYPH(SEG_A | SEG_D | SEG_E | SEG_F | SEG_N | SEG_J),                // E
+    GLYPH(SEG_A | SEG_E | SEG_F | SEG_N | SEG_J),                        // F
+    GLYPH(SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_J),                // G
+    GLYPH(SEG_B | SEG_C | SEG_E | SEG_F | SEG_N | SEG_J),                // H
+    GLYPH(SEG_A | SEG_D | SEG_G | SEG_L),                                // I
+    GLYPH(SEG_B | SEG_C | SEG_D | SEG_E),                                // J
+    GLYPH(SEG_H | SEG_K | SEG_E | SEG_F | SEG_N),                        // K
+    GLYPH(SEG_D | SEG_E | SEG_F),                                        // L
+    GLYPH(SEG_H | SEG_B | SEG_C | SEG_E | SEG_F | SEG_P),                // M
+    GLYPH(SEG_B | SEG_C | SEG_E | SEG_F | SEG_P | SEG_K),                // N
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),                // O
+    GLYPH(SEG_A | SEG_B | SEG_E | SEG_F | SEG_N | SEG_J),                // P
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_K),        // Q
+    GLYPH(SEG_A | SEG_B | SEG_K | SEG_E | SEG_F | SEG_N | SEG_J),        // R
+    GLYPH(SEG_A | SEG_P | SEG_J | SEG_C | SEG_D),                        // S
+    GLYPH(SEG_A | SEG_G | SEG_L),                                        // T
+    GLYPH(SEG_B | SEG_C | SEG_D | SEG_E | SEG_F),                        // U
+    GLYPH(SEG_H | SEG_M | SEG_F | SEG_E),                                // V
+    GLYPH(SEG_B | SEG_C | SEG_K | SEG_M | SEG_E | SEG_F),                // W
+    GLYPH(SEG_P | SEG_H | SEG_M | SEG_K),                                // X
+    GLYPH(SEG_P | SEG_H | SEG_L),                                        // Y
+    GLYPH(SEG_A | SEG_H | SEG_M | SEG_D),                                // Z
+    GLYPH(SEG_A | SEG_F | SEG_E | SEG_D),                                // [
+    GLYPH(SEG_P | SEG_K),                                                // \              :)
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D),                                // ]
+    GLYPH(SEG_G | SEG_A | SEG_B),                                        // ^
+    GLYPH(SEG_D),                                                        // _
+
+    GLYPH(SEG_P),                                                        // `
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_N | SEG_J),        // a
+    GLYPH(SEG_F | SEG_E | SEG_D | SEG_N | SEG_K),                        // b
+    GLYPH(SEG_N | SEG_J | SEG_E | SEG_D),                                // c
+    GLYPH(SEG_B | SEG_C | SEG_D | SEG_M | SEG_J),                        // d
+    GLYPH(SEG_N | SEG_E | SEG_M | SEG_D),                                // e
+    GLYPH(SEG_A | SEG_F | SEG_E | SEG_N),                                // f
+    GLYPH(SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_P | SEG_J),        // g
+    GLYPH(SEG_F | SEG_E | SEG_N | SEG_J | SEG_C),                        // h
+    GLYPH(SEG_L),                                                        // i
+    GLYPH(SEG_B | SEG_C | SEG_D),                                        // j
+    GLYPH(SEG_G | SEG_L | SEG_K | SEG_H),                                // k
+    GLYPH(SEG_G | SEG_L),                                                // l
+    GLYPH(SEG_E | SEG_L | SEG_C | SEG_N | SEG_J),                        // m
+    GLYPH(SEG_E | SEG_N | SEG_K),                                        // n
+    GLYPH(SEG_N | SEG_J | SEG_C | SEG_D | SEG_E),                        // o
+    GLYPH(SEG_A | SEG_F | SEG_E | SEG_N | SEG_H),                        // p
+    GLYPH(SEG_A | SEG_B | SEG_N | SEG_J | SEG_F | SEG_K),                // q
+    GLYPH(SEG_E | SEG_N),                                                // r
+    GLYPH(SEG_A | SEG_P | SEG_J | SEG_C | SEG_D),                        // s
+    GLYPH(SEG_F | SEG_E | SEG_D | SEG_N),                                // t
+    GLYPH(SEG_E | SEG_D | SEG_C),                                        // u
+    GLYPH(SEG_E | SEG_M),                                                // v
+    GLYPH(SEG_E | SEG_M | SEG_K | SEG_C),                                // w
+    GLYPH(SEG_P | SEG_H | SEG_M | SEG_K),                                // x
+    GLYPH(SEG_G | SEG_B | SEG_J | SEG_C | SEG_D),                        // y
+    GLYPH(SEG_A | SEG_H | SEG_M | SEG_D),                                // z
+    GLYPH(SEG_A | SEG_P | SEG_N | SEG_M | SEG_D),                        // {
+    GLYPH(SEG_G | SEG_L),                                                // |
+    GLYPH(SEG_A | SEG_H | SEG_J | SEG_K | SEG_D),                        // }
+    GLYPH(SEG_M | SEG_J),                                                // ~
+    GLYPH(UNDEFINED_GLYPH),                                              // DEL
 };
 
 
@@ -245,34 +269,133 @@ static const uint8_t atomicSymbolChars[] PROGMEM = {
 };
 
 
+#ifdef DISPLAY_MARQUEE
+/**
+    Element names, indexed by atomic number as atomicSymbolChars.
+
+    The names are packed one after another, each ending in a NUL.
+*/
+static const char elementNames[] PROGMEM =
+    "NOTHING\0"
+    "HYDROGEN\0"   "HELIUM\0"     "LITHIUM\0"    "BERYLLIUM\0"  "BORON\0"
+    "CARBON\0"     "NITROGEN\0"   "OXYGEN\0"     "FLUORINE\0"   "NEON\0"
+    "SODIUM\0"     "MAGNESIUM\0"  "ALUMINUM\0"   "SILICON\0"    "PHOSPHORUS\0"
+    "SULFUR\0"     "CHLORINE\0"   "ARGON\0"      "POTASSIUM\0"  "CALCIUM\0"
+    "SCANDIUM\0"   "TITANIUM\0"   "VANADIUM\0"   "CHROMIUM\0"   "MANGANESE\0"
+    "IRON\0"       "COBALT\0"     "NICKEL\0"     "COPPER\0"     "ZINC\0"
+    "GALLIUM\0"    "GERMANIUM\0"  "ARSENIC\0"    "SELENIUM\0"   "BROMINE\0"
+    "KRYPTON\0"    "RUBIDIUM\0"   "STRONTIUM\0"  "YTTRIUM\0"    "ZIRCONIUM\0"
+    "NIOBIUM\0"    "MOLYBDENUM\0" "TECHNETIUM\0" "RUTHENIUM\0"  "RHODIUM\0"
+    "PALLADIUM\0"  "SILVER\0"     "CADMIUM\0"    "INDIUM\0"     "TIN\0"
+    "ANTIMONY\0"   "TELLURIUM\0"  "IODINE\0"     "XENON\0"      "CESIUM\0"
+    "BARIUM\0"     "LANTHANUM\0"  "CERIUM\0"     "PRASEODYMIUM";
+
+
 /**
-    Setup the blink/scroll timer.
+    Get the name of an element.
+
+    @param n    The atomic number, up to 59.
+    @return     The name in program memory.
 */
-void setupDisplayTimer()
+static const char* getElementName(uint8_t n)
 {
-    TCCR0A |= (1 << WGM01);                   // Configure Timer0 for CTC mode
-    TCCR0B |= (1 << CS00) | (1 << CS02);      // Divide the Timer0 clock by 1024
-    TIMSK0 |= (1 << OCIE0A);                  // Enable the Timer0 CTC match interrupt
-    OCR0A = 244;                              // period = 249.9 milliseconds.
+    const char* name = elementNames;
+    while (n > 0)
+    {
+        if (pgm_read_byte(name) == '\0')
+        {
+            n--;
+        }
+        name++;
+    }
+    return name;
 }
+#endif
+
+
+/**
+    Brightness is set by blanking each digit again partway through its
+    refresh slot, from the Timer1 compare B interrupt.
+
+    Each level's blank count is the number of Timer1 counts into the tick
+    at which the digit is blanked.
+    A digit is latched at the start of its slot, but can't be blanked until
+    a blank word has been shifted in behind it, so the dimmest level blanks
+    each digit straight after the shift, and is lit for about the shift
+    time. The other levels are spread between the shift time and the end
+    of the slot. They follow a square law as an approximate gamma
+    correction, with an added linear term so that the first levels step
+    clear of the dimmest: a pure square law would put level 1 only a
+    forty-ninth of the way along.
+*/
+#define DISPLAY_BLANK_NEVER       0
+#define DISPLAY_BLANK_IMMEDIATE   0xff
+
+// Approximate CPU cycles taken to enter the interrupt and shift a word, in
+// Timer1 counts rounded up.
+#ifdef IO_SHIFT_USI
+#define DISPLAY_DRAW_CYCLES       (64 + 5 * IO_SHIFT_BITS)
+#else
+#define DISPLAY_DRAW_CYCLES       (64 + 16 * IO_SHIFT_BITS)
+#endif
+
+#define DISPLAY_DRAW_COUNT        ((DISPLAY_DRAW_CYCLES + TICK_TIMER_PRESCALE - 1) / TICK_TIMER_PRESCALE)
+
+#define DISPLAY_BLANK_COUNT(level)                                              \
+    (DISPLAY_DRAW_COUNT + (level) * ((level) + BRIGHTNESS_MAX) *                \
+    (TICK_TIMER_COUNT - DISPLAY_DRAW_COUNT) / (2 * BRIGHTNESS_MAX * BRIGHTNESS_MAX))
+
+#if TICK_TIMER_COUNT <= DISPLAY_DRAW_COUNT * 2
+#error "DISPLAY_DIGITS leaves too little time per digit for brightness control at this F_CPU"
+#endif
+
+#if TICK_TIMER_COUNT >= DISPLAY_BLANK_IMMEDIATE
+#error "TICK_RATE_HZ is too low for the blank counts"
+#endif
+
+static const uint8_t displayBlankCounts[BRIGHTNESS_LEVELS] PROGMEM = {
+    DISPLAY_BLANK_IMMEDIATE,
+    DISPLAY_BLANK_COUNT(1),
+    DISPLAY_BLANK_COUNT(2),
+    DISPLAY_BLANK_COUNT(3),
+    DISPLAY_BLANK_COUNT(4),
+    DISPLAY_BLANK_COUNT(5),
+    DISPLAY_BLANK_COUNT(6),
+    DISPLAY_BLANK_NEVER,
+};
+
+_Static_assert(sizeof(displayBlankCounts) == BRIGHTNESS_LEVELS, "displayBlankCounts needs one entry per brightness level");
+
+volatile static uint8_t displayBrightness = BRIGHTNESS_MAX;
+volatile static uint8_t displayTargetBrightness = BRIGHTNESS_MAX;
 
 volatile static uint8_t displayTimerCounter;
-ISR (TIM0_COMPA_vect)
+
+#ifdef DISPLAY_MARQUEE
+// Counts every ~250ms blink step, wrapping.
+volatile static uint8_t displayStepCount;
+#endif
+
+
+/**
+    Set whenever the prepared frame no longer matches what should be shown.
+*/
+volatile static bool displayIsStale = true;
+
+void invalidateDisplay()
 {
-    displayTimerCounter++;
-    if (displayTimerCounter > 3)
-    {
-        // Count four times before resetting.
-        // Each count is ~250ms, so resets once per second.
-        displayTimerCounter = 0;
-    }
+    displayIsStale = true;
 }
 
 
-static bool displayShouldBlink = false;
+volatile static bool displayShouldBlink = false;
 void setDisplayBlink(bool shouldBlink)
 {
-    displayShouldBlink = shouldBlink;
+    if (shouldBlink != displayShouldBlink)
+    {
+        displayShouldBlink = shouldBlink;
+        invalidateDisplay();
+    }
 }
 
 typedef enum
@@ -309,11 +432,131 @@ typedef enum
 } DisplayMode;
 
 
+#ifdef DISPLAY_MARQUEE
+/**
+    Marquee state.
+
+    The marquee scrolls up to two strings from program memory across the
+    display, one character every ~250ms, with a space between them. The
+    text starts with MARQUEE_LEAD_SPACES, so its first character scrolls in
+    from the right, and the marquee ends when the last has scrolled off the
+    left. A wider display shows more of the text at once.
+
+    The refresh interrupt only advances the position. The frame for each
+    position is built by updateDisplay(), so scrolling never adds to the
+    refresh.
+*/
+#define MARQUEE_LEAD_SPACES     (DISPLAY_DIGITS - 1)
+
+// Flipping the mode switch away from elements and back within this many
+// steps scrolls the element names of the time.
+#define MARQUEE_TRIGGER_STEPS   4
+
+static const char* marqueeParts[2];
+volatile static uint8_t marqueePosition = 0;
+volatile static bool isMarqueeActive = false;
+
+
+/**
+    Get a character of the marquee text.
+
+    @param index    The position of the character in the text.
+    @return         The character, or NUL past the end of the text.
+*/
+static char getMarqueeChar(uint8_t index)
+{
+    if (index < MARQUEE_LEAD_SPACES)
+    {
+        return ' ';
+    }
+    index -= MARQUEE_LEAD_SPACES;
+
+    for (uint8_t part = 0; part < 2 && marqueeParts[part] != NULL; ++part)
+    {
+        // Parts after the first are preceded by a space.
+        if (part > 0)
+        {
+            if (index == 0)
+            {
+                return ' ';
+            }
+            index--;
+        }
+
+        const char* text = marqueeParts[part];
+        char c;
+        while ((c = pgm_read_byte(text)) != '\0')
+        {
+            if (index == 0)
+            {
+                return c;
+            }
+            index--;
+            text++;
+        }
+    }
+
+    return '\0';
+}
+
+
+void showDisplayMarquee(const char* text1, const char* text2)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        marqueeParts[0] = text1;
+        marqueeParts[1] = text2;
+        marqueePosition = 0;
+        isMarqueeActive = true;
+    }
+    invalidateDisplay();
+}
+
+
+/**
+    Scroll the element names of the time if the mode switch has been
+    flipped away from elements and straight back.
+*/
+static void checkMarqueeTrigger()
+{
+    static bool wasElementModeSelected = false;
+    static bool hasLeftElementMode = false;
+    static uint8_t leftElementModeStep = 0;
+
+    bool isElementMode = isElementModeSelected();
+    if (isElementMode == wasElementModeSelected)
+    {
+        return;
+    }
+    wasElementModeSelected = isElementMode;
+
+    if ( ! isElementMode)
+    {
+        hasLeftElementMode = true;
+        leftElementModeStep = displayStepCount;
+    }
+    else if (hasLeftElementMode && (uint8_t) (displayStepCount - leftElementModeStep) <= MARQUEE_TRIGGER_STEPS)
+    {
+        uint32_t clockSnapshot = getClockSnapshot();
+        showDisplayMarquee(
+            getElementName(BCD_TO_BINARY(CLOCK_SNAPSHOT_HOURS_BCD(clockSnapshot))),
+            getElementName(BCD_TO_BINARY(CLOCK_SNAPSHOT_MINUTES_BCD(clockSnapshot))));
+    }
+}
+#endif
+
+
 /**
     Get the current display mode based on user selection.
 */
 DisplayMode getDisplayMode()
 {
+#ifdef DISPLAY_MARQUEE
+    if (isMarqueeActive)
+    {
+        return DISPLAY_MODE_SECRET_MESSAGE;
+    }
+#endif
     if (isElementModeSelected())
     {
         return DISPLAY_MODE_ELEMENTS;
@@ -327,31 +570,29 @@ DisplayMode getDisplayMode()
 /**
     Get segment data for the two symbols associated with a clock value.
 
-    @param n            The clock value.
+    @param bcd          The clock value, in packed BCD.
+    @param displayMode  The display mode to render the value in.
+    @param blinkState   The current blink state.
     @param pSymbol1     Pointer to output for Symbol 1 (the right digit)
     @param pSymbol2     Pointer to output for Symbol 2 (the left digit)
 */
-static void getSymbolData(uint8_t n, uint16_t* pSymbol1, uint16_t* pSymbol2)
+static void getSymbolData(uint8_t bcd, DisplayMode displayMode, BlinkState blinkState, uint16_t* pSymbol1, uint16_t* pSymbol2)
 {
     size_t symbolOffset1;
     size_t symbolOffset2;
-    DisplayMode displayMode = getDisplayMode();
+    uint8_t n;
 
     switch (displayMode)
     {
         case DISPLAY_MODE_ELEMENTS:
+            n = BCD_TO_BINARY(bcd);
             symbolOffset1 = pgm_read_byte(atomicSymbolChars + (2 * n) + 1);
             symbolOffset2 = pgm_read_byte(atomicSymbolChars + (2 * n));
             break;
 
         case DISPLAY_MODE_DIGITS:
-            symbolOffset1 = '0' + (n % 10);
-            symbolOffset2 = '0' + ((n / 10) % 10);
-            break;
-
-        case DISPLAY_MODE_SECRET_MESSAGE:
-            symbolOffset1 = 'X';
-            symbolOffset2 = 'X';
+            symbolOffset1 = '0' + BCD_ONES(bcd);
+            symbolOffset2 = '0' + BCD_TENS(bcd);
             break;
 
         default:
@@ -361,7 +602,6 @@ static void getSymbolData(uint8_t n, uint16_t* pSymbol1, uint16_t* pSymbol2)
     }
 
     // Check for blink state
-    BlinkState blinkState = getBlinkState();
     if (blinkState == BLINK_STATE_OFF)
     {
         symbolOffset1 = ' ';
@@ -372,64 +612,265 @@ static void getSymbolData(uint8_t n, uint16_t* pSymbol1, uint16_t* pSymbol2)
     *pSymbol2 = pgm_read_word(displayFont + symbolOffset2);
 }
 
-static void drawDigit(uint8_t digit, uint16_t symbol)
+/**
+    Get the digit select bits for a digit.
+*/
+static ShiftWord getDigitSelect(uint8_t digit)
 {
-    clearShiftRegister();
-
-    bool digitSelect1 = ! (digit & 0x01);
-    bool digitSelect2 = ! (digit & 0x02);
-
-    shiftOutBit(digitSelect2);
-    shiftOutBit( ! (symbol & SEG_E));
-    shiftOutBit( ! (symbol & SEG_M));
-    shiftOutBit( ! (symbol & SEG_L));
-    shiftOutBit( ! (symbol & SEG_K));
-    shiftOutBit( ! (symbol & SEG_J));
-    shiftOutBit( ! (symbol & SEG_D));
-    shiftOutBit( ! (symbol & SEG_C));
-
-    shiftOutBit( ! (symbol & SEG_F));
-    shiftOutBit( ! (symbol & SEG_P));
-    shiftOutBit( ! (symbol & SEG_G));
-    shiftOutBit( ! (symbol & SEG_H));
-    shiftOutBit( ! (symbol & SEG_N));
-    shiftOutBit( ! (symbol & SEG_A));
-    shiftOutBit( ! (symbol & SEG_B));
-    shiftOutBit(digitSelect1);
+    ShiftWord digitSelect = 0;
+    if ( ! (digit & 0x01))
+    {
+        digitSelect |= DIGIT_SELECT_1;
+    }
+    if ( ! (digit & 0x02))
+    {
+        digitSelect |= DIGIT_SELECT_2;
+    }
+#ifdef DIGIT_SELECT_3
+    if ( ! (digit & 0x04))
+    {
+        digitSelect |= DIGIT_SELECT_3;
+    }
+#endif
+    return digitSelect;
+}
 
-    latchShiftRegister();
+
+/**
+    Prepared display frame, indexed by digit from the right.
+
+    Each word is an encoded glyph including its digit select bits.
+
+    The frame is written by updateDisplay() and scanned out one digit at a
+    time by refreshDisplay(). It is only rebuilt when the display has
+    been invalidated or the display mode has changed.
+*/
+volatile static ShiftWord displayFrame[DISPLAY_DIGITS];
+
+
+/**
+    The digit in the shift stage, or showing on the outputs while a blank
+    word is shifted in behind it.
+
+    The refresh is pipelined. The next word is shifted into the shift stage
+    while the current digit is still lit from the output latch, so the
+    outputs only change on a single latch pulse, and are never dark while
+    shifting.
+*/
+volatile static uint8_t loadedDigit = 0;
+
+
+/**
+    Text shown in place of the time, leftmost character first.
+*/
+#define DISPLAY_TEXT_LENGTH     4
+
+static char displayText[DISPLAY_TEXT_LENGTH];
+static bool isDisplayShowingText = false;
+
+
+void showDisplayText(const char* text)
+{
+    for (uint8_t i = 0; i < DISPLAY_TEXT_LENGTH; ++i)
+    {
+        displayText[i] = text[i];
+    }
+    isDisplayShowingText = true;
+    invalidateDisplay();
 }
 
 
-static void blankDigit(uint8_t digit)
+void showDisplayTime()
 {
-    uint16_t symbol = pgm_read_word(displayFont + ' ');
-    drawDigit(digit, symbol);
+    isDisplayShowingText = false;
+    invalidateDisplay();
 }
 
 
-void drawDisplay()
+void updateDisplay()
 {
-    uint8_t clockHours = getClockHours();
-    bool isNight = clockHours >= 20;
+    static DisplayMode previousDisplayMode = DISPLAY_MODE_DIGITS;
+
+#ifdef DISPLAY_MARQUEE
+    checkMarqueeTrigger();
+    uint8_t position = marqueePosition;
+    if (isMarqueeActive && getMarqueeChar(position) == '\0')
+    {
+        isMarqueeActive = false;
+    }
+#endif
+
+    DisplayMode displayMode = getDisplayMode();
+
+    if ( ! displayIsStale && displayMode == previousDisplayMode)
+    {
+        return;
+    }
 
-    uint16_t symbols[4];
-    getSymbolData(getClockMinutes(), &symbols[0], &symbols[1]);
-    getSymbolData(clockHours, &symbols[2], &symbols[3]);
+    // Clear the flag before reading the time, so that a change made by an
+    // interrupt while the frame is being built is picked up next time.
+    displayIsStale = false;
+    previousDisplayMode = displayMode;
+
+    uint32_t clockSnapshot = getClockSnapshot();
+    uint8_t clockHoursBcd = CLOCK_SNAPSHOT_HOURS_BCD(clockSnapshot);
+    BlinkState blinkState = getBlinkState();
 
-    for (uint8_t i = 0; i < 4; ++i)
+    uint16_t symbols[DISPLAY_DIGITS];
+    if (isDisplayShowingText)
     {
-        if (isNight)
+        // Text is not blinked. Frame digit 0 is the rightmost character.
+        for (uint8_t i = 0; i < DISPLAY_DIGITS; ++i)
         {
-            blankDigit(i);
-            _delay_ms(1.995);
-            drawDigit(i, symbols[i]);
-            _delay_ms(0.005);
+            char c = (i < DISPLAY_TEXT_LENGTH) ? displayText[DISPLAY_TEXT_LENGTH - 1 - i] : ' ';
+            symbols[i] = pgm_read_word(displayFont + (uint8_t) c);
         }
-        else
+    }
+#ifdef DISPLAY_MARQUEE
+    else if (displayMode == DISPLAY_MODE_SECRET_MESSAGE)
+    {
+        // Fetch the whole window, leftmost character first.
+        for (uint8_t i = 0; i < DISPLAY_DIGITS; ++i)
         {
-            drawDigit(i, symbols[i]);
-            _delay_ms(2);
+            char c = getMarqueeChar(position + i);
+            symbols[DISPLAY_DIGITS - 1 - i] = pgm_read_word(displayFont + ((c == '\0') ? ' ' : c));
         }
     }
+#endif
+    else
+    {
+        // The hours take the leftmost pair of digits, followed by the
+        // minutes and then the seconds, and any pairs left over are blank.
+        getSymbolData(clockHoursBcd, displayMode, blinkState, &symbols[DISPLAY_DIGITS - 2], &symbols[DISPLAY_DIGITS - 1]);
+        getSymbolData(CLOCK_SNAPSHOT_MINUTES_BCD(clockSnapshot), displayMode, blinkState, &symbols[DISPLAY_DIGITS - 4], &symbols[DISPLAY_DIGITS - 3]);
+#if DISPLAY_DIGITS >= 6
+        getSymbolData(CLOCK_SNAPSHOT_SECONDS_BCD(clockSnapshot), displayMode, blinkState, &symbols[DISPLAY_DIGITS - 6], &symbols[DISPLAY_DIGITS - 5]);
+#endif
+        for (uint8_t i = 0; i + 6 < DISPLAY_DIGITS; ++i)
+        {
+            symbols[i] = pgm_read_word(displayFont + ' ');
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; i < DISPLAY_DIGITS; ++i)
+        {
+            displayFrame[i] = symbols[i] | getDigitSelect(i);
+        }
+    }
+
+    displayTargetBrightness = getTargetBrightness(BCD_TO_BINARY(clockHoursBcd));
+}
+
+
+void refreshDisplay()
+{
+    // Show the word loaded during the previous slot first, so that the
+    // digits change at a steady point in each tick.
+    latchShiftRegister();
+
+    // The word just latched is the loaded digit's.
+    if (loadedDigit == DISPLAY_DIGITS - 1)
+    {
+        PROFILE_REFRESH();
+    }
+
+    // Set up the blanking for this slot, while Timer1 is still below the
+    // lowest blank count. Clearing OCF1B discards a match left over from a
+    // slot that was not blanked. Slots that aren't blanked from the
+    // interrupt set the count the tick started at, which has just passed,
+    // so the next match is a full turn of Timer1 away.
+    uint8_t blankCount = pgm_read_byte(displayBlankCounts + displayBrightness);
+    if (blankCount == DISPLAY_BLANK_IMMEDIATE)
+    {
+        OCR1B = getTickStartCount();
+    }
+    else
+    {
+        OCR1B = getTickStartCount() + blankCount;
+    }
+    TIFR1 = (1 << OCF1B);
+
+    uint8_t digit = loadedDigit + 1;
+    if (digit >= DISPLAY_DIGITS)
+    {
+        digit = 0;
+    }
+    loadedDigit = digit;
+
+    // A blanked slot loads the blank word next, and the blanking loads
+    // the next digit behind it.
+    if (blankCount == DISPLAY_BLANK_NEVER)
+    {
+        shiftOutWord(displayFrame[digit]);
+    }
+    else
+    {
+        shiftOutWord(pgm_read_word(displayFont + ' '));
+    }
+
+    if (blankCount == DISPLAY_BLANK_IMMEDIATE)
+    {
+        latchShiftRegister();
+        shiftOutWord(displayFrame[digit]);
+    }
+}
+
+
+void stepDisplayFade()
+{
+    // Fade one level at a time towards the scheduled brightness.
+    if (displayBrightness < displayTargetBrightness)
+    {
+        displayBrightness++;
+    }
+    else if (displayBrightness > displayTargetBrightness)
+    {
+        displayBrightness--;
+    }
+}
+
+
+void stepDisplayBlink()
+{
+#ifdef DISPLAY_MARQUEE
+    displayStepCount++;
+
+    if (isMarqueeActive)
+    {
+        marqueePosition++;
+        invalidateDisplay();
+    }
+#endif
+
+    // Count four times before resetting.
+    // Each count is ~250ms, so resets once per second.
+    displayTimerCounter++;
+    if (displayTimerCounter > 3)
+    {
+        displayTimerCounter = 0;
+    }
+
+    // The blink state flips every second count.
+    if (displayShouldBlink && (displayTimerCounter & 0x01) == 0)
+    {
+        invalidateDisplay();
+    }
+}
+
+
+ISR (TIM1_COMPB_vect)
+{
+    PROFILE_BEGIN(PROFILE_BLANK);
+
+    latchShiftRegister();
+
+    // The serial port can't wait for the shift. The tick can, and must, or
+    // it would latch a half shifted word.
+    openSerialWindow();
+    shiftOutWord(displayFrame[loadedDigit]);
+    closeSerialWindow();
+
+    PROFILE_END(PROFILE_BLANK);
 }
@@ -7,16 +7,97 @@
 
 #include <stdbool.h>
 
+
+/**
+    Display size.
+
+    DISPLAY_DIGITS is the number of digits on the board, in pairs, each
+    pair showing one clock value: 4 for HH:MM, 6 for HH:MM:SS, or 8 for a
+    wider board that scrolls longer element names. Digits are multiplexed
+    one per system tick, and the tick rate scales with the digit count, so
+    the whole display always refreshes at DISPLAY_REFRESH_HZ and each digit
+    gets an equal share of it.
+*/
+#ifndef DISPLAY_DIGITS
+#define DISPLAY_DIGITS          4
+#endif
+
+#ifndef DISPLAY_REFRESH_HZ
+#define DISPLAY_REFRESH_HZ      125
+#endif
+
+#if DISPLAY_DIGITS != 4 && DISPLAY_DIGITS != 6 && DISPLAY_DIGITS != 8
+#error "DISPLAY_DIGITS must be 4, 6 or 8"
+#endif
+
+
+/**
+    Show the next display digit.
+
+    Scheduled every system tick, one digit per tick.
+*/
+void refreshDisplay();
+
+
+/**
+    Fade the brightness one level towards the scheduled brightness.
+
+    Scheduled from the system tick, and sets the fade rate.
+*/
+void stepDisplayFade();
+
+
+/**
+    Advance the blink and marquee by one step.
+
+    Scheduled from the system tick every 250 milliseconds.
+*/
+void stepDisplayBlink();
+
+
+/**
+    Prepare the display characters for the current time.
+
+    The prepared frame is shown by the display refresh interrupt. It is only
+    rebuilt when the display has been invalidated or the mode has changed.
+*/
+void updateDisplay();
+
+
+/**
+    Show text in place of the time until showDisplayTime() is called.
+
+    The text is shown on the rightmost four digits, with any others blank.
+
+    @param text     Four printable ASCII characters, leftmost first.
+                    The text is copied, and need not be terminated.
+*/
+void showDisplayText(const char* text);
+
+
+/**
+    Return to showing the time after showDisplayText().
+*/
+void showDisplayTime();
+
+
 /**
-    Setup the display timer.
+    Scroll text across the display once, in place of the time, in
+    DISPLAY_MARQUEE builds.
+
+    @param text1    NUL terminated text in program memory.
+    @param text2    More text in program memory, scrolled after a space,
+                    or NULL.
 */
-void setupDisplayTimer();
+void showDisplayMarquee(const char* text1, const char* text2);
 
 
 /**
-    Draw the display characters.
+    Mark the prepared display frame as out of date.
+
+    Safe to call from interrupt handlers.
 */
-void drawDisplay();
+void invalidateDisplay();
 
 
 /**
@@ -0,0 +1,92 @@
+/**
+    Hardware abstraction layer.
+
+    Firmware sources include this instead of the AVR headers, so the same
+    clock and display logic can be built natively against a simulated chip
+    (see host/hal_host.h) by defining HOST_BUILD.
+
+    Timer registers, interrupt vectors, program memory and EEPROM access
+    keep their avr-libc names on both targets. Ports A and B are only
+    accessed through the functions below, so the host can observe every pin
+    transition.
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef HOST_BUILD
+
+#include "../host/hal_host.h"
+
+#else
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+
+
+/**
+    Configure port A pins as outputs.
+*/
+static inline void halEnableOutputs(uint8_t mask)
+{
+    DDRA |= mask;
+}
+
+
+/**
+    Drive port A pins high, or enable their pullups if they are inputs.
+*/
+static inline void halSetPins(uint8_t mask)
+{
+    PORTA |= mask;
+}
+
+
+/**
+    Drive port A pins low, or disable their pullups if they are inputs.
+*/
+static inline void halClearPins(uint8_t mask)
+{
+    PORTA &= ~mask;
+}
+
+
+/**
+    Read the logic levels of port A.
+*/
+static inline uint8_t halReadPins()
+{
+    return PINA;
+}
+
+
+/**
+    Enable the pullups of port B input pins.
+
+    Port B is only used for inputs, since PB0 and PB1 hold the crystal.
+*/
+static inline void halSetPortBPins(uint8_t mask)
+{
+    PORTB |= mask;
+}
+
+
+/**
+    Read the logic levels of port B.
+*/
+static inline uint8_t halReadPortBPins()
+{
+    return PINB;
+}
+
+#endif
+
+#endif
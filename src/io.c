@@ -1,34 +1,156 @@
 
 #include "io.h"
-#include <util/delay.h>
 
 
-#define SHIFT_CLOCK_DELAY_US  2
+/**
+    Shift register pulse width.
+
+    The 74HC595 needs its data setup, clock and latch pulses to last at
+    least SHIFT_PULSE_NS at a 2 V supply. Each pin change already takes
+    SHIFT_PIN_CYCLES, so the pulses are only stretched when that is shorter,
+    which it never is up to 20 MHz.
+*/
+#define SHIFT_PULSE_NS      100
+#define SHIFT_PIN_CYCLES    2
+
+static inline void waitShiftPulse()
+{
+#if SHIFT_PULSE_NS * (F_CPU / 1000) > SHIFT_PIN_CYCLES * 1000000L
+    _delay_us(SHIFT_PULSE_NS / 1000.0);
+#endif
+}
+
+
+// Time for the pullups to charge the input lines at power up.
+#define INPUT_SETTLE_DELAY_US 10
+
+
+/**
+    Input snapshot state, see sampleInputs().
+*/
+#define INPUT_COUNT 2
+
+static uint8_t inputIntegrators[INPUT_COUNT];
+volatile static uint8_t inputSnapshot = 0;
+volatile static uint8_t inputPresses = 0;
+
+
+/**
+    Read the input pins, which are active low.
+
+    @return     The INPUT_ bits of the inputs that read active.
+*/
+static uint8_t readInputPins()
+{
+    uint8_t pins = halReadPins();
+    uint8_t activeInputs = 0;
+    if ( ! (pins & IO_PIN_SPEED_BUTTON))
+    {
+        activeInputs |= INPUT_SPEED_BUTTON;
+    }
+    if ( ! (pins & IO_PIN_ELEMENT_MODE_SWITCH))
+    {
+        activeInputs |= INPUT_ELEMENT_MODE;
+    }
+    return activeInputs;
+}
 
 
 void setupChipIo()
 {
     // Enable outputs
-    DDRA |= IO_PIN_SHIFT_DATA;
-    DDRA |= IO_PIN_SHIFT_CLOCK;
-    DDRA |= IO_PIN_SHIFT_LATCH;
-    DDRA |= IO_PIN_SHIFT_CLEAR;
+    halEnableOutputs(IO_PIN_SHIFT_DATA);
+    halEnableOutputs(IO_PIN_SHIFT_CLOCK);
+    halEnableOutputs(IO_PIN_SHIFT_LATCH);
+    halEnableOutputs(IO_PIN_SHIFT_CLEAR);
+
+    // Release the shift register clear, which is active low. Every word
+    // shifted in replaces the whole shift stage, so it is never cleared.
+    // Start with every output high, which turns every segment off.
+    halSetPins(IO_PIN_SHIFT_CLEAR);
+    shiftOutWord((ShiftWord) ~0);
+    latchShiftRegister();
 
     // Enable pullups on inputs
-    PORTA |= IO_PIN_ELEMENT_MODE_SWITCH;
-    PORTA |= IO_PIN_SPEED_BUTTON;
+    halSetPins(IO_PIN_ELEMENT_MODE_SWITCH);
+    halSetPins(IO_PIN_SPEED_BUTTON);
+
+    // Wake from sleep when an input changes
+    PCMSK0 |= IO_PIN_ELEMENT_MODE_SWITCH | IO_PIN_SPEED_BUTTON;
+    GIMSK |= (1 << PCIE0);
+
+    // Start the snapshot from the inputs as they are at power up, so that
+    // a button held at power up is seen straight away.
+    _delay_us(INPUT_SETTLE_DELAY_US);
+    uint8_t activeInputs = readInputPins();
+    for (uint8_t i = 0; i < INPUT_COUNT; ++i)
+    {
+        inputIntegrators[i] = (activeInputs & (1 << i)) ? INPUT_DEBOUNCE_SAMPLES : 0;
+    }
+    inputSnapshot = activeInputs;
+}
+
+
+// The pin change interrupt only needs to wake the main loop.
+EMPTY_INTERRUPT (PCINT0_vect);
+
+
+void sampleInputs()
+{
+    uint8_t activeInputs = readInputPins();
+    uint8_t snapshot = inputSnapshot;
+
+    for (uint8_t i = 0; i < INPUT_COUNT; ++i)
+    {
+        uint8_t input = (1 << i);
+        if (activeInputs & input)
+        {
+            if (inputIntegrators[i] < INPUT_DEBOUNCE_SAMPLES && ++inputIntegrators[i] == INPUT_DEBOUNCE_SAMPLES)
+            {
+                snapshot |= input;
+            }
+        }
+        else
+        {
+            if (inputIntegrators[i] > 0 && --inputIntegrators[i] == 0)
+            {
+                snapshot &= ~input;
+            }
+        }
+    }
+
+    inputPresses |= snapshot & ~inputSnapshot;
+    inputSnapshot = snapshot;
+}
+
+
+uint8_t getInputs()
+{
+    return inputSnapshot;
+}
+
+
+uint8_t takeInputPresses()
+{
+    uint8_t presses;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        presses = inputPresses;
+        inputPresses = 0;
+    }
+    return presses;
 }
 
 
 bool isSpeedButtonPressed()
 {
-    return ! (PINA & IO_PIN_SPEED_BUTTON);
+    return inputSnapshot & INPUT_SPEED_BUTTON;
 }
 
 
 bool isElementModeSelected()
 {
-    return ! (PINA & IO_PIN_ELEMENT_MODE_SWITCH);
+    return inputSnapshot & INPUT_ELEMENT_MODE;
 }
 
 
@@ -36,37 +158,87 @@ void shiftOutBit(bool bit)
 {
     if (bit)
     {
-        PORTA |= IO_PIN_SHIFT_DATA;
+        halSetPins(IO_PIN_SHIFT_DATA);
     }
     else
     {
-        PORTA &= ~IO_PIN_SHIFT_DATA;
+        halClearPins(IO_PIN_SHIFT_DATA);
     }
 
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA |= IO_PIN_SHIFT_CLOCK;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA &= ~IO_PIN_SHIFT_CLOCK;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
+    waitShiftPulse();
+    halSetPins(IO_PIN_SHIFT_CLOCK);
+    waitShiftPulse();
+    halClearPins(IO_PIN_SHIFT_CLOCK);
+    waitShiftPulse();
 }
 
 
-void latchShiftRegister()
+#ifdef IO_SHIFT_USI
+
+/**
+    Clock one byte out of the USI in three-wire mode.
+
+    Each write toggles USCK; the first of each pair raises it, and the
+    second lowers it and also shifts the data register. Each write is a
+    single out instruction, so each bit takes two cycles.
+*/
+static inline void usiShiftOutByte(uint8_t byte)
+{
+    const uint8_t toggle = (1 << USIWM0) | (1 << USITC);
+    const uint8_t toggleShift = (1 << USIWM0) | (1 << USITC) | (1 << USICLK);
+
+    USIDR = byte;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+    USICR = toggle;
+    USICR = toggleShift;
+}
+
+
+void shiftOutWord(ShiftWord word)
+{
+#if IO_SHIFT_BITS == 32
+    usiShiftOutByte(word >> 24);
+#endif
+#if IO_SHIFT_BITS >= 24
+    usiShiftOutByte(word >> 16);
+#endif
+    usiShiftOutByte(word >> 8);
+    usiShiftOutByte(word & 0xff);
+}
+
+#else
+
+void shiftOutWord(ShiftWord word)
 {
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA |= IO_PIN_SHIFT_LATCH;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA &= ~IO_PIN_SHIFT_LATCH;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
+    for (uint8_t i = 0; i < IO_SHIFT_BITS; ++i)
+    {
+        shiftOutBit(word & ((ShiftWord) 1 << (IO_SHIFT_BITS - 1)));
+        word <<= 1;
+    }
 }
 
+#endif
 
-void clearShiftRegister()
+
+void latchShiftRegister()
 {
-    // Register clear is active low
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA &= ~IO_PIN_SHIFT_CLEAR;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
-    PORTA |= IO_PIN_SHIFT_CLEAR;
-    _delay_us(SHIFT_CLOCK_DELAY_US);
+    waitShiftPulse();
+    halSetPins(IO_PIN_SHIFT_LATCH);
+    waitShiftPulse();
+    halClearPins(IO_PIN_SHIFT_LATCH);
+    waitShiftPulse();
 }
+
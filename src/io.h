@@ -6,19 +6,54 @@
 */
 
 #include <stdbool.h>
+#include <stdint.h>
 
-#include <avr/io.h>
+#include "hal.h"
 
 
 /**
     IO pin configuration.
+
+    By default the shift register is bit-banged on PA0 and PA2.
+    Define IO_SHIFT_USI for boards wired to shift with the USI instead,
+    which drives the data from DO (PA5) and the clock from USCK (PA4).
+    The inputs then move to the pins freed by the bit-banged interface.
 */
+#ifdef IO_SHIFT_USI
+#define IO_PIN_SHIFT_DATA            (1 << PA5)
+#define IO_PIN_SHIFT_CLOCK           (1 << PA4)
+#define IO_PIN_SHIFT_LATCH           (1 << PA3)
+#define IO_PIN_SHIFT_CLEAR           (1 << PA1)
+#define IO_PIN_ELEMENT_MODE_SWITCH   (1 << PA0)
+#define IO_PIN_SPEED_BUTTON          (1 << PA2)
+#else
 #define IO_PIN_SHIFT_DATA            (1 << PA0)
 #define IO_PIN_SHIFT_CLOCK           (1 << PA2)
 #define IO_PIN_SHIFT_LATCH           (1 << PA3)
 #define IO_PIN_SHIFT_CLEAR           (1 << PA1)
 #define IO_PIN_ELEMENT_MODE_SWITCH   (1 << PA5)
 #define IO_PIN_SPEED_BUTTON          (1 << PA4)
+#endif
+
+
+/**
+    Shift register chain length, in bits.
+
+    Boards chain 8-bit shift registers. A 4 digit display takes two, and
+    wider displays, which need a third digit select line, take three or
+    four. Words are shifted out in ShiftWord.
+*/
+#ifndef IO_SHIFT_BITS
+#define IO_SHIFT_BITS                16
+#endif
+
+#if IO_SHIFT_BITS == 16
+typedef uint16_t ShiftWord;
+#elif IO_SHIFT_BITS == 24 || IO_SHIFT_BITS == 32
+typedef uint32_t ShiftWord;
+#else
+#error "IO_SHIFT_BITS must be 16, 24 or 32"
+#endif
 
 
 /**
@@ -34,18 +69,60 @@
         IO_PIN_ELEMENT_MODE_SWITCH    : Display mode switch (active low).
         IO_PIN_SPEED_BUTTON           : Clock speedup mode for setting time (active low).
 
+    Changes on either input raise a pin change interrupt to wake the chip.
+
 */
 void setupChipIo();
 
 
 /**
-    Check if the speed button is pressed.
+    Debounced inputs, as bits of the input snapshot.
+*/
+#define INPUT_SPEED_BUTTON      (1 << 0)
+#define INPUT_ELEMENT_MODE      (1 << 1)
+
+
+/**
+    Sample the input pins and update the input snapshot.
+
+    Each input is debounced with an integrator, which counts up while the
+    input reads active and down while it reads inactive. The snapshot only
+    changes once the integrator reaches its limit, which takes
+    INPUT_DEBOUNCE_SAMPLES consecutive samples.
+
+    Called from the system tick at INPUT_SAMPLE_RATE_HZ.
+*/
+#define INPUT_SAMPLE_RATE_HZ    100
+#define INPUT_DEBOUNCE_SAMPLES  3       // 30 milliseconds
+
+void sampleInputs();
+
+
+/**
+    Get the input snapshot.
+
+    @return     The INPUT_ bits of the inputs that are active.
+*/
+uint8_t getInputs();
+
+
+/**
+    Get the inputs that have become active since the last call, and clear
+    them.
+
+    @return     The INPUT_ bits of the inputs that were pressed.
+*/
+uint8_t takeInputPresses();
+
+
+/**
+    Check if the speed button is pressed, from the input snapshot.
 */
 bool isSpeedButtonPressed();
 
 
 /**
-    Check if Element mode is selected.
+    Check if Element mode is selected, from the input snapshot.
 */
 bool isElementModeSelected();
 
@@ -59,12 +136,21 @@ void shiftOutBit(bool bit);
 
 
 /**
-    Clear shift register outputs.
+    Shift a word into the shift register chain, most significant of its
+    IO_SHIFT_BITS bits first.
+
+    Port accesses and pulse delays per 16 bits, as counted by the host
+    build's `clock bench`. The loop and call overhead come on top, so these
+    are lower bounds:
+        Bit-banged  : 96 cycles
+        USI         : 34 cycles
+
+    @param word  The word to shift out.
 */
-void latchShiftRegister();
+void shiftOutWord(ShiftWord word);
 
 
 /**
-    Clear the shift register.
+    Copy the shift stage onto the shift register outputs.
 */
-void clearShiftRegister();
+void latchShiftRegister();
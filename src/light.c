@@ -0,0 +1,142 @@
+
+#include "hal.h"
+#include "brightness.h"
+#include "display.h"
+#include "adc.h"
+#include "light.h"
+
+#ifdef LIGHT_SENSOR
+
+
+/**
+    Light filtering.
+
+    Each burst adds up ADC_OVERSAMPLES conversions, back to back, which
+    also averages out mains flicker from the room lights. The sums are then
+    smoothed by an exponential filter, which moves
+    1 / 2^LIGHT_FILTER_SHIFT of the way to each new sum, so the display
+    follows the room within a second or two, but not a passing shadow.
+*/
+#define LIGHT_OVERSAMPLE_SHIFT  ADC_OVERSAMPLE_SHIFT
+#define LIGHT_FILTER_SHIFT      2
+
+
+/**
+    Filtered light level at the threshold between each brightness level
+    and the next, in ADC counts. The thresholds are spaced by octaves,
+    since the eye responds to ratios of light rather than differences.
+
+    Hysteresis of 1 / 2^LIGHT_HYSTERESIS_SHIFT of each threshold, either
+    side, keeps the level from flickering.
+*/
+static const uint16_t lightThresholds[BRIGHTNESS_MAX] PROGMEM = {
+    4, 8, 16, 32, 64, 128, 256,
+};
+
+#define LIGHT_HYSTERESIS_SHIFT  2
+
+
+/**
+    Light sensor state.
+*/
+static bool isLightSensorSetup = false;
+
+volatile static uint16_t filteredLightSum = 0;
+volatile static bool isLightFiltered = false;
+volatile static uint8_t ambientBrightness = BRIGHTNESS_MAX;
+
+static void filterLight(uint16_t sum);
+
+
+void setupLightSensor()
+{
+    DIDR0 |= (1 << LIGHT_ADC_CHANNEL);          // Disable the pin's digital input
+    isLightSensorSetup = true;
+}
+
+
+void sampleLight()
+{
+    if (isLightSensorSetup)
+    {
+        startAdcBurst(LIGHT_ADC_CHANNEL, filterLight);      // Measure against VCC
+    }
+}
+
+
+uint16_t getAmbientLight()
+{
+    uint16_t sum;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        sum = filteredLightSum;
+    }
+    return sum >> LIGHT_OVERSAMPLE_SHIFT;
+}
+
+
+uint8_t getAmbientBrightness()
+{
+    return ambientBrightness;
+}
+
+
+/**
+    Move the brightness level across any thresholds that the light has
+    passed by more than the hysteresis.
+
+    @param lightSum     Filtered sum of a burst of samples.
+*/
+static uint8_t getBrightnessForLight(uint8_t level, uint16_t lightSum)
+{
+    while (level < BRIGHTNESS_MAX)
+    {
+        uint16_t threshold = pgm_read_word(lightThresholds + level) << LIGHT_OVERSAMPLE_SHIFT;
+        if (lightSum < threshold + (threshold >> LIGHT_HYSTERESIS_SHIFT))
+        {
+            break;
+        }
+        level++;
+    }
+
+    while (level > 0)
+    {
+        uint16_t threshold = pgm_read_word(lightThresholds + level - 1) << LIGHT_OVERSAMPLE_SHIFT;
+        if (lightSum >= threshold - (threshold >> LIGHT_HYSTERESIS_SHIFT))
+        {
+            break;
+        }
+        level--;
+    }
+
+    return level;
+}
+
+
+/**
+    Filter a burst of light sensor samples, and update the brightness
+    level.
+
+    Called from the ADC interrupt.
+*/
+static void filterLight(uint16_t sum)
+{
+    // The first burst sets the filter straight away, rather than fading in
+    // from dark.
+    if (isLightFiltered)
+    {
+        int16_t change = (int16_t) (sum - filteredLightSum) >> LIGHT_FILTER_SHIFT;
+        sum = filteredLightSum + change;
+    }
+    filteredLightSum = sum;
+
+    uint8_t level = getBrightnessForLight(isLightFiltered ? ambientBrightness : 0, sum);
+    isLightFiltered = true;
+    if (level != ambientBrightness)
+    {
+        ambientBrightness = level;
+        invalidateDisplay();
+    }
+}
+
+#endif
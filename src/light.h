@@ -0,0 +1,56 @@
+/**
+    Ambient light sensor.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Light sensor input.
+
+    A light dependent resistor from VCC to PA6 (ADC6), with a fixed
+    resistor from PA6 to ground, so the reading rises as the room gets
+    brighter. PA6 is free on both shift register wirings.
+*/
+#define LIGHT_ADC_CHANNEL       6
+#define LIGHT_ADC_MAX           1023
+
+
+/**
+    Setup the light sensor input.
+
+    The sensor is only read once this and setupAdc() have been called.
+*/
+void setupLightSensor();
+
+
+/**
+    Start a burst of light sensor conversions, which completes in the
+    background from the ADC interrupt.
+
+    Scheduled from the system tick. Does nothing unless the sensor has
+    been set up, or while the previous burst is still converting or
+    waiting for the ADC.
+*/
+void sampleLight();
+
+
+/**
+    Get the filtered light level.
+
+    @return     ADC counts, 0 to LIGHT_ADC_MAX.
+*/
+uint16_t getAmbientLight();
+
+
+/**
+    Get the display brightness level for the filtered light level.
+
+    The level only changes once the light has moved well past the
+    threshold between two levels, so a light level that hovers near a
+    threshold doesn't make the display flicker. Each change invalidates
+    the display.
+
+    @return     Brightness level, BRIGHTNESS_MAX until the sensor has been read.
+*/
+uint8_t getAmbientBrightness();
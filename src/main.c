@@ -5,13 +5,19 @@
     @date   August 5, 2016
 */
 
-#include <avr/interrupt.h>
-
+#include "hal.h"
 #include "io.h"
 #include "clock.h"
 #include "display.h"
-
-#include <util/delay.h>
+#include "calibration.h"
+#include "backup.h"
+#include "adc.h"
+#include "light.h"
+#include "temperature.h"
+#include "tick.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "serial.h"
 
 /**
     Firmware entry point.
@@ -19,23 +25,50 @@
 int main()
 {
     setupChipIo();
-    setupClockTimer();
-    setupDisplayTimer();
+#ifdef OSCILLATOR_CALIBRATION
+    loadCalibration();
+#endif
+#ifdef TEMPERATURE_COMPENSATION
+    loadTemperatureCurve();
+#endif
+#ifdef TIME_BACKUP
+    restoreClockTime();
+#endif
+#ifdef SERIAL_PORT
+    setupSerial();
+#endif
+#if defined(LIGHT_SENSOR) || defined(TEMPERATURE_COMPENSATION)
+    setupAdc();
+#endif
+    setupSystemTick();
+#ifdef BRIGHTNESS_LIGHT_SENSOR
+    setupLightSensor();
+#endif
     sei();
 
-    // The display should blink at powerup to indicate power failure.
+#ifdef OSCILLATOR_CALIBRATION
+    openCalibrationIfRequested();
+#endif
+#ifdef PROFILE
+    startDiagnostics();
+#endif
+
+    // The display should blink at powerup to indicate power failure, even
+    // if a saved time was restored, since the clock stopped while the
+    // power was off.
     setDisplayBlink(true);
 
+    // The timers run from the I/O clock, so Idle is the deepest sleep mode
+    // that keeps the clock and display refresh running.
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
     while (true)
     {
-        clockCheckSpeedMode();
-        drawDisplay();
-
-        // Stop blinking if speed mode is ever used to set the clock.
-        if (isSpeedButtonPressed())
-        {
-            setDisplayBlink(false);
-        }
+        runBackgroundTasks();
+        PROFILE_LOOP();
+
+        // Sleep until the next timer or pin change interrupt.
+        sleep_mode();
     }
 
 }
@@ -0,0 +1,238 @@
+
+#include "hal.h"
+#include "clock.h"
+#include "display.h"
+#include "tick.h"
+#include "calibration.h"
+#include "decimal.h"
+#include "profile.h"
+
+#ifdef PROFILE
+
+
+/**
+    Profiling figures for each path, in Timer1 counts.
+
+    The average moves 1 / 2^PROFILE_AVERAGE_SHIFT of the way to each new
+    run, and keeps PROFILE_AVERAGE_SHIFT fractional bits.
+*/
+#define PROFILE_AVERAGE_SHIFT   4
+
+typedef struct
+{
+    bool isRecorded;
+    uint16_t minimum;
+    uint16_t average;
+    uint16_t maximum;
+} ProfileStats;
+
+static ProfileStats profileStats[PROFILE_POINT_COUNT];
+
+
+/**
+    Rate counters, latched once a second.
+*/
+volatile static uint16_t profileRefreshCount = 0;
+static uint16_t profileLoopCount = 0;
+static uint16_t refreshRate = 0;
+static uint16_t loopRate = 0;
+static uint8_t profileSecondsBcd = 0xff;
+
+
+/**
+    Diagnostic display pages.
+
+    The time is shown for DIAGNOSTIC_TIME_PAGES, then each path's label
+    and its three figures, then the two rates.
+*/
+#define DIAGNOSTIC_TIME_PAGES   4
+#define DIAGNOSTIC_PATH_PAGES   (PROFILE_POINT_COUNT * 4)
+#define DIAGNOSTIC_PAGE_COUNT   (DIAGNOSTIC_TIME_PAGES + DIAGNOSTIC_PATH_PAGES + 4)
+
+static const char diagnosticLabels[PROFILE_POINT_COUNT + 2][4] PROGMEM = {
+    { 'T', 'I', 'C', 'K' },
+    { 'B', 'L', 'N', 'K' },
+    { 'R', 'F', 'S', 'H' },
+    { 'L', 'O', 'O', 'P' },
+};
+
+static bool isDiagnosticsActive = false;
+static uint8_t diagnosticPage = 0;
+
+
+uint16_t readProfileTime()
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = TCNT1;
+    }
+    return count;
+}
+
+
+void recordProfile(ProfilePoint point, uint16_t time)
+{
+    ProfileStats* stats = &profileStats[point];
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if ( ! stats->isRecorded)
+        {
+            // The first run sets all of the figures.
+            stats->isRecorded = true;
+            stats->minimum = time;
+            stats->average = time << PROFILE_AVERAGE_SHIFT;
+        }
+        else
+        {
+            int16_t change = (int16_t) ((time << PROFILE_AVERAGE_SHIFT) - stats->average) >> PROFILE_AVERAGE_SHIFT;
+            stats->average += change;
+        }
+
+        if (time < stats->minimum)
+        {
+            stats->minimum = time;
+        }
+        if (time > stats->maximum)
+        {
+            stats->maximum = time;
+        }
+    }
+}
+
+
+void countProfileRefresh()
+{
+    profileRefreshCount++;
+}
+
+
+void getProfileCycles(ProfilePoint point, uint32_t* pMinimum, uint32_t* pAverage, uint32_t* pMaximum)
+{
+    ProfileStats stats;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        stats = profileStats[point];
+    }
+
+    *pMinimum = (uint32_t) stats.minimum * TICK_TIMER_PRESCALE;
+    *pAverage = ((uint32_t) stats.average * TICK_TIMER_PRESCALE) >> PROFILE_AVERAGE_SHIFT;
+    *pMaximum = (uint32_t) stats.maximum * TICK_TIMER_PRESCALE;
+}
+
+
+uint16_t getRefreshRate()
+{
+    return refreshRate;
+}
+
+
+uint16_t getLoopRate()
+{
+    return loopRate;
+}
+
+
+void startDiagnostics()
+{
+    isDiagnosticsActive = true;
+    diagnosticPage = 0;
+}
+
+
+/**
+    Show a number on the display, right aligned.
+
+    @param n    The number, shown as 9999 if larger.
+*/
+static void showNumber(uint32_t n)
+{
+    char digits[DECIMAL_DIGITS_MAX];
+    uint8_t length = formatDecimal((n > 9999) ? 9999 : n, digits);
+
+    char text[4] = { ' ', ' ', ' ', ' ' };
+    for (uint8_t i = 0; i < length; ++i)
+    {
+        text[4 - length + i] = digits[i];
+    }
+    showDisplayText(text);
+}
+
+
+/**
+    Show the current diagnostic page, then move on to the next.
+*/
+static void stepDiagnostics()
+{
+    uint8_t page = diagnosticPage;
+    diagnosticPage = (page + 1 < DIAGNOSTIC_PAGE_COUNT) ? page + 1 : 0;
+
+    if (page < DIAGNOSTIC_TIME_PAGES)
+    {
+        showDisplayTime();
+        return;
+    }
+    page -= DIAGNOSTIC_TIME_PAGES;
+
+    // Each label is followed by its figures.
+    uint8_t label = page >> 2;
+    uint8_t figure = page & 0x03;
+    if (page >= DIAGNOSTIC_PATH_PAGES)
+    {
+        label = PROFILE_POINT_COUNT + ((page - DIAGNOSTIC_PATH_PAGES) >> 1);
+        figure = (page - DIAGNOSTIC_PATH_PAGES) & 0x01;
+    }
+
+    if (figure == 0)
+    {
+        char text[4];
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            text[i] = pgm_read_byte(&diagnosticLabels[label][i]);
+        }
+        showDisplayText(text);
+    }
+    else if (label == PROFILE_POINT_COUNT)
+    {
+        showNumber(refreshRate);
+    }
+    else if (label == PROFILE_POINT_COUNT + 1)
+    {
+        showNumber(loopRate);
+    }
+    else
+    {
+        uint32_t cycles[3];
+        getProfileCycles(label, &cycles[0], &cycles[1], &cycles[2]);
+        showNumber(cycles[figure - 1]);
+    }
+}
+
+
+void countProfileLoop()
+{
+    profileLoopCount++;
+
+    uint8_t secondsBcd = CLOCK_SNAPSHOT_SECONDS_BCD(getClockSnapshot());
+    if (secondsBcd == profileSecondsBcd)
+    {
+        return;
+    }
+    profileSecondsBcd = secondsBcd;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        refreshRate = profileRefreshCount;
+        profileRefreshCount = 0;
+    }
+    loopRate = profileLoopCount;
+    profileLoopCount = 0;
+
+    // The calibration screen keeps the display while it is open.
+    if (isDiagnosticsActive && ! isCalibrationOpen())
+    {
+        stepDiagnostics();
+    }
+}
+
+#endif
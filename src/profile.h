@@ -0,0 +1,120 @@
+/**
+    Self-profiling and diagnostic display.
+
+    Only built when PROFILE is defined, with `make PROFILE=1`. Otherwise the
+    profiling macros compile to nothing, and release builds carry no
+    profiling code or state.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Profiled code paths.
+*/
+typedef enum
+{
+    PROFILE_TICK,           // The system tick interrupt
+    PROFILE_BLANK,          // The display blanking interrupt
+    PROFILE_POINT_COUNT,
+} ProfilePoint;
+
+
+/**
+    Time a path from PROFILE_BEGIN() to PROFILE_END() in the same block,
+    count whole display refreshes with PROFILE_REFRESH(), and count main
+    loop iterations with PROFILE_LOOP().
+*/
+#ifdef PROFILE
+#define PROFILE_BEGIN(point)    uint16_t profileStart_##point = readProfileTime()
+#define PROFILE_END(point)      recordProfile(point, readProfileTime() - profileStart_##point)
+#define PROFILE_REFRESH()       countProfileRefresh()
+#define PROFILE_LOOP()          countProfileLoop()
+#else
+#define PROFILE_BEGIN(point)
+#define PROFILE_END(point)
+#define PROFILE_REFRESH()
+#define PROFILE_LOOP()
+#endif
+
+
+#ifdef PROFILE
+
+/**
+    Read Timer1 for profiling.
+
+    @return     The Timer1 count, TICK_TIMER_PRESCALE cycles each.
+*/
+uint16_t readProfileTime();
+
+
+/**
+    Add a run of a profiled path to its figures.
+
+    @param point    The path.
+    @param time     Timer1 counts the path took.
+*/
+void recordProfile(ProfilePoint point, uint16_t time);
+
+
+/**
+    Count a whole display refresh.
+
+    Called from refreshDisplay() as it latches the last digit.
+*/
+void countProfileRefresh();
+
+
+/**
+    Count a main loop iteration, and step the diagnostic display once a
+    second.
+
+    Called from the main loop.
+*/
+void countProfileLoop();
+
+
+/**
+    Get the figures for a profiled path, in CPU cycles.
+
+    Times are measured in Timer1 counts, so are rounded down to a multiple
+    of TICK_TIMER_PRESCALE cycles.
+
+    @param point        The path.
+    @param pMinimum     Set to the shortest run.
+    @param pAverage     Set to a running average of recent runs.
+    @param pMaximum     Set to the longest run.
+*/
+void getProfileCycles(ProfilePoint point, uint32_t* pMinimum, uint32_t* pAverage, uint32_t* pMaximum);
+
+
+/**
+    Get the display refresh rate measured over the last second.
+
+    @return     Whole display refreshes per second.
+*/
+uint16_t getRefreshRate();
+
+
+/**
+    Get the main loop rate measured over the last second.
+
+    @return     Main loop iterations per second.
+*/
+uint16_t getLoopRate();
+
+
+/**
+    Start the diagnostic display. Profiling builds start it at power up.
+
+    The display then pages through the profiling figures, one page a
+    second, between a few seconds of the time:
+
+        TICK, BLNK  Each path's label, followed by its minimum, average
+                    and maximum cycles.
+        RFSH        Followed by the refresh rate in Hz.
+        LOOP        Followed by the main loop iterations per second.
+*/
+void startDiagnostics();
+
+#endif
@@ -0,0 +1,240 @@
+
+#include "hal.h"
+#include "io.h"
+#include "display.h"
+#include "timeset.h"
+#include "calibration.h"
+#include "backup.h"
+#include "light.h"
+#include "temperature.h"
+#include "serial.h"
+#include "tick.h"
+#include "scheduler.h"
+
+
+/**
+    Task periods, in system ticks.
+
+    The clock time is only saved when the minute changes, so the backup
+    task just needs to check often enough to save soon after. The
+    temperature changes slowly, but is sampled often so that the filter can
+    smooth out the sensor's noise. Periods are
+    rounded to whole ticks where the tick rate doesn't divide evenly.
+*/
+#define TASK_PERIOD_REFRESH     1                                       // One digit
+#define TASK_PERIOD_INPUTS      ((TICK_RATE_HZ + INPUT_SAMPLE_RATE_HZ / 2) / INPUT_SAMPLE_RATE_HZ) // ~10 milliseconds
+#define TASK_PERIOD_FADE        (TICK_RATE_HZ / 16)                     // ~60 milliseconds per level
+#define TASK_PERIOD_BLINK       (TICK_RATE_HZ / 4)                      // 250 milliseconds
+#define TASK_PERIOD_LIGHT       (TICK_RATE_HZ / 8)                      // ~125 milliseconds
+#define TASK_PERIOD_FRAME       1
+#define TASK_PERIOD_BACKUP      (TICK_RATE_HZ / 4)                      // 250 milliseconds
+#define TASK_PERIOD_TEMPERATURE (TICK_RATE_HZ / 4)                      // 250 milliseconds
+#define TASK_PERIOD_SERIAL      1
+
+#if TASK_PERIOD_INPUTS < 1
+#error "TICK_RATE_HZ is too low for INPUT_SAMPLE_RATE_HZ"
+#endif
+
+#if TASK_PERIOD_FADE < 1 || TASK_PERIOD_BLINK > 255 || TASK_PERIOD_BACKUP > 255 || \
+    TASK_PERIOD_TEMPERATURE > 255
+#error "TICK_RATE_HZ is out of range for the task periods"
+#endif
+
+
+/**
+    The task table.
+
+    Tick tasks run straight from the system tick interrupt, so must finish
+    well within a tick. The serial port's interrupts can be taken while
+    they run, so any state shared with those is guarded as in the main
+    loop. Background tasks are only marked as due by the tick, and run
+    from the main loop, so they may block.
+*/
+typedef struct
+{
+    void (*run)();
+    uint8_t period;
+    bool isBackground;
+} Task;
+
+#ifdef TIME_BACKUP
+static void saveClockTimeIfIdle();
+#endif
+
+static const Task tasks[TASK_COUNT] PROGMEM = {
+    [TASK_REFRESH_DISPLAY]      = { refreshDisplay,        TASK_PERIOD_REFRESH,      false },
+    [TASK_SAMPLE_INPUTS]        = { sampleInputs,          TASK_PERIOD_INPUTS,       false },
+    [TASK_UPDATE_TIME_SET]      = { updateTimeSet,         TASK_PERIOD_INPUTS,       false },
+#ifdef OSCILLATOR_CALIBRATION
+    [TASK_UPDATE_CALIBRATION]   = { updateCalibration,     TASK_PERIOD_INPUTS,       true  },
+#endif
+    [TASK_FADE_DISPLAY]         = { stepDisplayFade,       TASK_PERIOD_FADE,         false },
+    [TASK_BLINK_DISPLAY]        = { stepDisplayBlink,      TASK_PERIOD_BLINK,        false },
+#ifdef LIGHT_SENSOR
+    [TASK_SAMPLE_LIGHT]         = { sampleLight,           TASK_PERIOD_LIGHT,        false },
+#endif
+    [TASK_UPDATE_DISPLAY]       = { updateDisplay,         TASK_PERIOD_FRAME,        true  },
+#ifdef TIME_BACKUP
+    [TASK_SAVE_CLOCK_TIME]      = { saveClockTimeIfIdle,   TASK_PERIOD_BACKUP,       true  },
+#endif
+#ifdef TEMPERATURE_COMPENSATION
+    [TASK_SAMPLE_TEMPERATURE]   = { sampleTemperature,     TASK_PERIOD_TEMPERATURE,  true  },
+#endif
+#ifdef SERIAL_PORT
+    [TASK_SERVICE_SERIAL]       = { serviceSerial,         TASK_PERIOD_SERIAL,       true  },
+#endif
+};
+
+#if TASK_COUNT > 16
+#error "Too many tasks for the due task mask"
+#endif
+
+
+/**
+    Scheduler state.
+
+    Each countdown is the number of ticks until its task is next due.
+    Background tasks stay marked as due until they finish running.
+*/
+static uint8_t taskCountdowns[TASK_COUNT];
+volatile static uint16_t backgroundTasksDue = 0;
+
+/**
+    Task figures, only kept for the serial port to report.
+*/
+#ifdef SERIAL_PORT
+static uint16_t taskWorstCases[TASK_COUNT];
+volatile static uint8_t taskOverruns[TASK_COUNT];
+#endif
+
+
+/**
+    The time is only saved once it has been set, rather than at every step.
+*/
+#ifdef TIME_BACKUP
+static void saveClockTimeIfIdle()
+{
+    if ( ! isTimeSetActive())
+    {
+        saveClockTime();
+    }
+}
+#endif
+
+
+#ifdef SERIAL_PORT
+static uint16_t readTaskTime()
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = TCNT1;
+    }
+    return count;
+}
+
+
+static void countOverrun(uint8_t task)
+{
+    if (taskOverruns[task] < 0xff)
+    {
+        taskOverruns[task]++;
+    }
+}
+#else
+#define countOverrun(task)
+#endif
+
+
+/**
+    Run a task and update its worst case execution time.
+
+    @return     The time the task took, or 0 in builds that don't keep the
+                task figures.
+*/
+static uint16_t runTask(uint8_t task)
+{
+    void (*run)() = pgm_read_ptr(&tasks[task].run);
+#ifndef SERIAL_PORT
+    run();
+    return 0;
+#else
+
+    uint16_t startTime = readTaskTime();
+    run();
+    uint16_t elapsedTime = readTaskTime() - startTime;
+
+    if (elapsedTime > taskWorstCases[task])
+    {
+        taskWorstCases[task] = elapsedTime;
+    }
+    return elapsedTime;
+#endif
+}
+
+
+void runTickTasks()
+{
+    for (uint8_t task = 0; task < TASK_COUNT; ++task)
+    {
+        if (taskCountdowns[task] != 0)
+        {
+            taskCountdowns[task]--;
+            continue;
+        }
+
+        uint8_t period = pgm_read_byte(&tasks[task].period);
+        taskCountdowns[task] = period - 1;
+
+        if (pgm_read_byte(&tasks[task].isBackground))
+        {
+            uint16_t taskBit = 1 << task;
+            if (backgroundTasksDue & taskBit)
+            {
+                countOverrun(task);
+            }
+            backgroundTasksDue |= taskBit;
+        }
+        else if (runTask(task) >= (uint16_t) period * TICK_TIMER_COUNT)
+        {
+            countOverrun(task);
+        }
+    }
+}
+
+
+void runBackgroundTasks()
+{
+    for (uint8_t task = 0; task < TASK_COUNT; ++task)
+    {
+        uint16_t taskBit = 1 << task;
+
+        // The tick only sets bits, so a torn read of the mask can only miss
+        // a task that has just come due, which then runs on the next pass.
+        if ( ! (backgroundTasksDue & taskBit))
+        {
+            continue;
+        }
+
+        runTask(task);
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            backgroundTasksDue &= ~taskBit;
+        }
+    }
+}
+
+
+#ifdef SERIAL_PORT
+uint16_t getTaskWorstCase(TaskId task)
+{
+    return taskWorstCases[task];
+}
+
+
+uint8_t getTaskOverruns(TaskId task)
+{
+    return taskOverruns[task];
+}
+#endif
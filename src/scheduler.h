@@ -0,0 +1,77 @@
+/**
+    Cooperative task scheduler.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Scheduled tasks, in the order they run when due in the same tick.
+    Optional features only add their tasks when built in.
+*/
+typedef enum
+{
+    TASK_REFRESH_DISPLAY,
+    TASK_SAMPLE_INPUTS,
+    TASK_UPDATE_TIME_SET,
+#ifdef OSCILLATOR_CALIBRATION
+    TASK_UPDATE_CALIBRATION,
+#endif
+    TASK_FADE_DISPLAY,
+    TASK_BLINK_DISPLAY,
+#ifdef LIGHT_SENSOR
+    TASK_SAMPLE_LIGHT,
+#endif
+    TASK_UPDATE_DISPLAY,
+#ifdef TIME_BACKUP
+    TASK_SAVE_CLOCK_TIME,
+#endif
+#ifdef TEMPERATURE_COMPENSATION
+    TASK_SAMPLE_TEMPERATURE,
+#endif
+#ifdef SERIAL_PORT
+    TASK_SERVICE_SERIAL,
+#endif
+    TASK_COUNT,
+} TaskId;
+
+
+/**
+    Run the tasks due this tick, and mark background tasks as due.
+
+    Called from the system tick interrupt.
+*/
+void runTickTasks();
+
+
+/**
+    Run the background tasks that have come due.
+
+    Called from the main loop. Background tasks may be interrupted by the
+    system tick, so they may take longer than a tick.
+*/
+void runBackgroundTasks();
+
+
+/**
+    Get the longest a task has taken to run, in SERIAL_PORT builds.
+
+    @param task     The task.
+    @return         Time in system tick timer counts, TICK_TIMER_PRESCALE
+                    cycles each. Background task times include any
+                    interrupts taken while they ran.
+*/
+uint16_t getTaskWorstCase(TaskId task);
+
+
+/**
+    Get the number of times a task has overrun, in SERIAL_PORT builds.
+
+    A task overruns when it takes longer than its period, or a background
+    task comes due again before its last run has finished, which drops a
+    run.
+
+    @param task     The task.
+    @return         The overrun count, saturating at 255.
+*/
+uint8_t getTaskOverruns(TaskId task);
@@ -0,0 +1,522 @@
+
+#include "hal.h"
+#include "clock.h"
+#include "display.h"
+#include "scheduler.h"
+#include "tick.h"
+#include "profile.h"
+#include "temperature.h"
+#include "decimal.h"
+#include "serial.h"
+
+#ifdef SERIAL_PORT
+
+
+/**
+    Bit timing.
+
+    Timer0 clears once per bit, and its compare value never changes, so an
+    interrupt that runs before the clear can't make it miss the match.
+    Received bits are sampled a quarter of the way in, rather than in the
+    middle, since other interrupts can only make a sample late. See the
+    interrupt latency budget in tick.c.
+*/
+#define SERIAL_TIMER_PRESCALE   8
+#define SERIAL_BIT_COUNT        ((F_CPU / SERIAL_TIMER_PRESCALE + SERIAL_BAUD / 2) / SERIAL_BAUD)
+#define SERIAL_SAMPLE_COUNT     (SERIAL_BIT_COUNT / 4)
+
+#if SERIAL_BIT_COUNT < 16 || SERIAL_BIT_COUNT > 0x100
+#error "SERIAL_BAUD is out of range for Timer0 at this F_CPU"
+#endif
+
+#if F_CPU / SERIAL_TIMER_PRESCALE * 100 > SERIAL_BIT_COUNT * SERIAL_BAUD * 101 || \
+    F_CPU / SERIAL_TIMER_PRESCALE * 100 < SERIAL_BIT_COUNT * SERIAL_BAUD * 99
+#error "SERIAL_BAUD can't be kept within 1% at this F_CPU"
+#endif
+
+
+/**
+    Port state.
+
+    The port is either idle, waiting for a start bit, or busy receiving or
+    sending one byte. Bits count through the start bit, the data bits, then
+    the stop bit.
+*/
+typedef enum
+{
+    SERIAL_IDLE,
+    SERIAL_RECEIVING,
+    SERIAL_SENDING,
+} SerialState;
+
+volatile static uint8_t serialState = SERIAL_IDLE;
+volatile static uint8_t serialBit;
+volatile static uint8_t serialByte;
+
+
+/**
+    Received command line.
+
+    Bytes are dropped once the line is ready, until the command has been
+    taken. The length keeps counting one past the buffer, so an overlong
+    line can be refused.
+*/
+#define SERIAL_LINE_SIZE        10
+
+static char serialLine[SERIAL_LINE_SIZE];
+volatile static uint8_t serialLineLength = 0;
+volatile static bool isSerialLineReady = false;
+
+
+/**
+    Bytes waiting to be sent.
+
+    Only the interrupt moves the head, and only the task moves the tail.
+    The reply is queued one field at a time, once there is room for the
+    longest field.
+*/
+#define SERIAL_QUEUE_SIZE       16      // A power of two
+#define SERIAL_FIELD_SIZE       12
+
+static char serialQueue[SERIAL_QUEUE_SIZE];
+volatile static uint8_t serialQueueHead = 0;
+volatile static uint8_t serialQueueTail = 0;
+
+
+/**
+    The command being replied to, or NUL, and the next field of its reply.
+*/
+static char serialCommand = '\0';
+static uint8_t serialReplyField = 0;
+
+
+/**
+    Start Timer0 counting bits.
+
+    @param count    Timer0 counts to the first interrupt, up to a bit.
+*/
+static void startBitTimer(uint8_t count)
+{
+    TCNT0 = SERIAL_BIT_COUNT - count;
+    TIFR0 = (1 << OCF0A);
+    TIMSK0 |= (1 << OCIE0A);
+}
+
+
+/**
+    Go idle, and wait for a start bit.
+
+    Clearing the flag discards pin changes from the last byte.
+*/
+static void listenForStartBit()
+{
+    TIMSK0 &= ~(1 << OCIE0A);
+    serialState = SERIAL_IDLE;
+    GIFR = (1 << PCIF1);
+    PCMSK1 |= (1 << PCINT10);
+}
+
+
+void setupSerial()
+{
+    halSetPins(SERIAL_PIN_TX);                  // Idle high
+    halEnableOutputs(SERIAL_PIN_TX);
+    halSetPortBPins(SERIAL_PIN_RX);             // Pull up the receive line
+
+    TCCR0A = (1 << WGM01);                      // Clear Timer0 on compare match A
+    TCCR0B = (1 << CS01);                       // Divide the Timer0 clock by 8
+    OCR0A = SERIAL_BIT_COUNT - 1;
+    GIMSK |= (1 << PCIE1);                      // Enable the port B pin change interrupt
+    listenForStartBit();
+}
+
+
+/**
+    Add a received byte to the command line.
+*/
+static void receiveByte(char c)
+{
+    if (isSerialLineReady)
+    {
+        return;
+    }
+
+    // Empty lines are ignored, so a line can end in CR, LF or both.
+    uint8_t length = serialLineLength;
+    if (c == '\r' || c == '\n')
+    {
+        isSerialLineReady = (length != 0);
+        return;
+    }
+
+    if (length < SERIAL_LINE_SIZE)
+    {
+        serialLine[length] = c;
+    }
+    if (length <= SERIAL_LINE_SIZE)
+    {
+        serialLineLength = length + 1;
+    }
+}
+
+
+/**
+    Start sending the next queued byte with its start bit.
+*/
+static void sendStartBit()
+{
+    serialByte = serialQueue[serialQueueHead & (SERIAL_QUEUE_SIZE - 1)];
+    serialQueueHead++;
+    serialBit = 1;
+    halClearPins(SERIAL_PIN_TX);
+}
+
+
+ISR (PCINT1_vect)
+{
+    // Only a falling edge starts a byte.
+    if (halReadPortBPins() & SERIAL_PIN_RX)
+    {
+        return;
+    }
+
+    PCMSK1 &= ~(1 << PCINT10);
+    serialState = SERIAL_RECEIVING;
+    serialBit = 0;
+    serialByte = 0;
+    startBitTimer(SERIAL_SAMPLE_COUNT);
+}
+
+
+ISR (TIM0_COMPA_vect)
+{
+    uint8_t bit = serialBit;
+
+    if (serialState == SERIAL_RECEIVING)
+    {
+        // A start bit that has ended already was a glitch.
+        bool isHigh = halReadPortBPins() & SERIAL_PIN_RX;
+        if (bit == 0 && isHigh)
+        {
+            listenForStartBit();
+        }
+        else if (bit < 9)
+        {
+            serialByte = (serialByte >> 1) | (isHigh ? 0x80 : 0);
+            serialBit = bit + 1;
+        }
+        else
+        {
+            // A low stop bit is a framing error, and the byte is dropped.
+            if (isHigh)
+            {
+                receiveByte(serialByte);
+            }
+            listenForStartBit();
+        }
+        return;
+    }
+
+    if (bit < 9)
+    {
+        if (serialByte & 0x01)
+        {
+            halSetPins(SERIAL_PIN_TX);
+        }
+        else
+        {
+            halClearPins(SERIAL_PIN_TX);
+        }
+        serialByte >>= 1;
+        serialBit = bit + 1;
+    }
+    else if (bit == 9)
+    {
+        halSetPins(SERIAL_PIN_TX);              // Stop bit
+        serialBit = bit + 1;
+
+        // Listen through the last stop bit, so that a command sent straight
+        // after a reply isn't missed.
+        if (serialQueueHead == serialQueueTail)
+        {
+            GIFR = (1 << PCIF1);
+            PCMSK1 |= (1 << PCINT10);
+        }
+    }
+    else if (serialQueueHead != serialQueueTail)
+    {
+        PCMSK1 &= ~(1 << PCINT10);
+        sendStartBit();
+    }
+    else
+    {
+        listenForStartBit();
+    }
+}
+
+
+/**
+    Start sending the queue, unless the port is busy.
+*/
+static void startSending()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (serialState == SERIAL_IDLE && serialQueueHead != serialQueueTail)
+        {
+            PCMSK1 &= ~(1 << PCINT10);
+            serialState = SERIAL_SENDING;
+            sendStartBit();
+            startBitTimer(SERIAL_BIT_COUNT);
+        }
+    }
+}
+
+
+static void writeChar(char c)
+{
+    serialQueue[serialQueueTail & (SERIAL_QUEUE_SIZE - 1)] = c;
+    serialQueueTail++;
+}
+
+
+/**
+    Queue a number in decimal.
+*/
+static void writeNumber(uint32_t n)
+{
+    char text[DECIMAL_DIGITS_MAX];
+    uint8_t length = formatDecimal(n, text);
+    for (uint8_t i = 0; i < length; ++i)
+    {
+        writeChar(text[i]);
+    }
+}
+
+
+/**
+    Queue a signed number in decimal.
+*/
+static void writeSignedNumber(int16_t n)
+{
+    if (n < 0)
+    {
+        writeChar('-');
+        n = -n;
+    }
+    writeNumber(n);
+}
+
+
+static void writeBcd(uint8_t bcd)
+{
+    writeChar('0' + BCD_TENS(bcd));
+    writeChar('0' + BCD_ONES(bcd));
+}
+
+
+/**
+    Parse two decimal digits.
+
+    @return     The value, or 0xff if they aren't digits.
+*/
+static uint8_t parseDigits(const char* text)
+{
+    uint8_t tens = text[0] - '0';
+    uint8_t ones = text[1] - '0';
+    if (tens > 9 || ones > 9)
+    {
+        return 0xff;
+    }
+    return (tens << 3) + (tens << 1) + ones;
+}
+
+
+#ifdef TEMPERATURE_COMPENSATION
+/**
+    Parse a sign and two decimal digits.
+
+    @return     The value, or INT8_MIN if they aren't a sign and digits.
+*/
+static int8_t parseSignedDigits(const char* text)
+{
+    uint8_t magnitude = parseDigits(text + 1);
+    if (magnitude > 99 || (text[0] != '+' && text[0] != '-'))
+    {
+        return INT8_MIN;
+    }
+    return (text[0] == '-') ? -magnitude : magnitude;
+}
+#endif
+
+
+/**
+    Carry out the received command line.
+
+    @return     The command to reply to, or '?' if the line is not a
+                command.
+*/
+static char runSerialCommand()
+{
+    uint8_t length = serialLineLength;
+    char command = serialLine[0];
+
+    if (length == 1 && (command == 'T' || command == 'K' || command == 'W'))
+    {
+        return command;
+    }
+#ifdef TEMPERATURE_COMPENSATION
+    if (length == 1 && command == 'C')
+    {
+        return command;
+    }
+#endif
+#ifdef PROFILE
+    if (length == 1 && command == 'P')
+    {
+        return command;
+    }
+#endif
+
+    if (length == 7 && command == 'T')
+    {
+        uint8_t hours = parseDigits(serialLine + 1);
+        uint8_t minutes = parseDigits(serialLine + 3);
+        uint8_t seconds = parseDigits(serialLine + 5);
+        if (hours < 24 && minutes < 60 && seconds < 60)
+        {
+            setClockTime(hours, minutes, seconds);
+            setDisplayBlink(false);
+            return command;
+        }
+    }
+
+#ifdef TEMPERATURE_COMPENSATION
+    if (length == 10 && command == 'C')
+    {
+        int8_t turnover = parseSignedDigits(serialLine + 1);
+        int8_t linear = parseSignedDigits(serialLine + 4);
+        int8_t quadratic = parseSignedDigits(serialLine + 7);
+        if (turnover != INT8_MIN && linear != INT8_MIN && quadratic != INT8_MIN)
+        {
+            setTemperatureCurve(turnover, linear, quadratic);
+            return command;
+        }
+    }
+#endif
+
+    return '?';
+}
+
+
+/**
+    Queue one field of the reply to a command.
+
+    @return     False once the reply has been queued.
+*/
+static bool writeReplyField(char command, uint8_t field)
+{
+    if (field == 0)
+    {
+        writeChar(command);
+    }
+
+    switch (command)
+    {
+        case 'T':
+        {
+            uint32_t clockSnapshot = getClockSnapshot();
+            writeChar(' ');
+            writeBcd(CLOCK_SNAPSHOT_HOURS_BCD(clockSnapshot));
+            writeBcd(CLOCK_SNAPSHOT_MINUTES_BCD(clockSnapshot));
+            writeBcd(CLOCK_SNAPSHOT_SECONDS_BCD(clockSnapshot));
+            break;
+        }
+
+        case 'K':
+            writeChar(' ');
+            writeSignedNumber(getClockTrim());
+            break;
+
+#ifdef TEMPERATURE_COMPENSATION
+        case 'C':
+            writeChar(' ');
+            writeSignedNumber(getTemperature());
+            writeChar(',');
+            writeSignedNumber(getClockCompensation());
+            break;
+#endif
+
+        case 'W':
+            if (field < TASK_COUNT)
+            {
+                writeChar(' ');
+                writeNumber((uint32_t) getTaskWorstCase(field) * TICK_TIMER_PRESCALE);
+                writeChar(',');
+                writeNumber(getTaskOverruns(field));
+                return true;
+            }
+            break;
+
+#ifdef PROFILE
+        case 'P':
+            if (field < PROFILE_POINT_COUNT * 3)
+            {
+                // Three fields per point, each figure in its own.
+                uint8_t point = 0;
+                uint8_t figure = field;
+                while (figure >= 3)
+                {
+                    figure -= 3;
+                    point++;
+                }
+
+                uint32_t cycles[3];
+                getProfileCycles(point, &cycles[0], &cycles[1], &cycles[2]);
+                writeChar((figure == 0) ? ' ' : ',');
+                writeNumber(cycles[figure]);
+                return true;
+            }
+            else if (field == PROFILE_POINT_COUNT * 3)
+            {
+                writeChar(' ');
+                writeNumber(getRefreshRate());
+                return true;
+            }
+            writeChar(' ');
+            writeNumber(getLoopRate());
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    writeChar('\n');
+    return false;
+}
+
+
+void serviceSerial()
+{
+    if (serialCommand == '\0' && isSerialLineReady)
+    {
+        serialCommand = runSerialCommand();
+        serialReplyField = 0;
+        serialLineLength = 0;
+        isSerialLineReady = false;
+    }
+
+    while (serialCommand != '\0' &&
+        (uint8_t) (serialQueueTail - serialQueueHead) <= SERIAL_QUEUE_SIZE - SERIAL_FIELD_SIZE)
+    {
+        if ( ! writeReplyField(serialCommand, serialReplyField++))
+        {
+            serialCommand = '\0';
+        }
+    }
+
+    startSending();
+}
+
+#endif
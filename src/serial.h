@@ -0,0 +1,77 @@
+/**
+    Serial time set and telemetry.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Serial port.
+
+    A half duplex software UART on the spare pins, timed by Timer0, with
+    8 data bits, no parity and one stop bit. It receives on PB2, since PB0
+    and PB1 hold the crystal, and sends on PA7, which is free on both shift
+    register wirings.
+
+    Timer0 runs in CTC mode, clearing once per bit, so it is not free for
+    PWM. The rate leaves room for other interrupts to hold off the bit
+    interrupt, within the budget set out in tick.c.
+*/
+#define SERIAL_PIN_RX           (1 << PB2)
+#define SERIAL_PIN_TX           (1 << PA7)
+
+#ifndef SERIAL_BAUD
+#if F_CPU >= 8000000
+#define SERIAL_BAUD             4800
+#else
+#define SERIAL_BAUD             1200
+#endif
+#endif
+
+
+/**
+    Setup the serial port.
+*/
+void setupSerial();
+
+
+/**
+    Carry out a received command, and queue its reply.
+
+    Scheduled from the system tick as a background task. The reply is sent
+    from the Timer0 interrupt, a few bytes at a time, so a long reply never
+    holds up the other background tasks.
+
+    Commands are lines of ASCII ending in a carriage return, a newline or
+    both, and each is answered with one line ending in a newline:
+
+        T           Read the time. Replies "T hhmmss".
+        Thhmmss     Set the time. The new second starts when the command
+                    is carried out, at the first tick after the line
+                    ending, or later if background tasks such as the
+                    EEPROM backup run first. W reports how long those can
+                    take. Replies as T.
+        K           Read the oscillator trim. Replies "K" and the trim in
+                    parts per million, such as "K -12".
+        C           Read the temperature compensation, in
+                    TEMPERATURE_COMPENSATION builds. Replies "C", the
+                    temperature in degrees C and the correction in parts
+                    per million, such as "C 31,-2".
+        C+tt+ll+qq  Set and save the oscillator temperature curve, each
+                    coefficient a sign and two digits, as the turnover
+                    temperature, linear and quadratic coefficients of
+                    setTemperatureCurve(). The correction follows within
+                    a second. Replies as C.
+        W           Read the scheduler's figures. Replies "W", then the
+                    worst case cycles and overrun count of each task, in
+                    TaskId order, such as "W 96,0 8,0 ...".
+        P           Read the profiling figures, in PROFILE builds. Replies
+                    "P", then the minimum, average and maximum cycles of
+                    each ProfilePoint, then the refresh rate and main loop
+                    rate, such as "P 96,120,200 ... 125 520".
+
+    Anything else, including a line that is too long, is answered with "?",
+    and empty lines are ignored.
+    A line sent while a reply is being sent is lost.
+*/
+void serviceSerial();
@@ -0,0 +1,155 @@
+
+#include "hal.h"
+#include "adc.h"
+#include "clock.h"
+#include "temperature.h"
+
+#ifdef TEMPERATURE_COMPENSATION
+
+
+/**
+    Temperature filtering, as for the light level, by
+    1 / 2^TEMPERATURE_FILTER_SHIFT. The filtered sum is in sixteenths of an
+    ADC count, so of a degree.
+*/
+#define TEMPERATURE_FILTER_SHIFT        2
+
+volatile static uint16_t filteredTemperatureSum = 0;
+volatile static bool isTemperatureFiltered = false;
+
+
+/**
+    The oscillator temperature curve.
+
+    The curve is stored inverted, so that erased EEPROM reads as a flat
+    curve.
+*/
+typedef struct
+{
+    int8_t turnover;
+    int8_t linear;
+    int8_t quadratic;
+} TemperatureCurve;
+
+static TemperatureCurve temperatureCurve;
+static TemperatureCurve EEMEM temperatureCurveStorage = { -1, -1, -1 };
+
+
+/**
+    Limit on the distance from the turnover, in sixteenths of a degree, so
+    that the correction can be worked out in 32 bits.
+*/
+#define TEMPERATURE_DIFFERENCE_LIMIT    (128 << ADC_OVERSAMPLE_SHIFT)
+
+
+void loadTemperatureCurve()
+{
+    TemperatureCurve curve;
+    eeprom_read_block(&curve, &temperatureCurveStorage, sizeof(curve));
+
+    temperatureCurve.turnover = ~curve.turnover;
+    temperatureCurve.linear = ~curve.linear;
+    temperatureCurve.quadratic = ~curve.quadratic;
+}
+
+
+void setTemperatureCurve(int8_t turnover, int8_t linear, int8_t quadratic)
+{
+    temperatureCurve.turnover = turnover;
+    temperatureCurve.linear = linear;
+    temperatureCurve.quadratic = quadratic;
+
+    TemperatureCurve curve = { ~turnover, ~linear, ~quadratic };
+    eeprom_update_block(&curve, &temperatureCurveStorage, sizeof(curve));
+}
+
+
+/**
+    Filter a burst of temperature sensor samples.
+
+    Called from the ADC interrupt.
+*/
+static void filterTemperature(uint16_t sum)
+{
+    // The first burst sets the filter straight away.
+    if (isTemperatureFiltered)
+    {
+        int16_t change = (int16_t) (sum - filteredTemperatureSum) >> TEMPERATURE_FILTER_SHIFT;
+        sum = filteredTemperatureSum + change;
+    }
+    filteredTemperatureSum = sum;
+    isTemperatureFiltered = true;
+}
+
+
+/**
+    Get the filtered temperature in sixteenths of a degree C.
+*/
+static int16_t getFilteredTemperature()
+{
+    uint16_t sum;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        sum = filteredTemperatureSum;
+    }
+    return (int16_t) (sum - (TEMPERATURE_ADC_OFFSET << ADC_OVERSAMPLE_SHIFT));
+}
+
+
+int8_t getTemperature()
+{
+    if ( ! isTemperatureFiltered)
+    {
+        return 0;
+    }
+    return (getFilteredTemperature() + (1 << (ADC_OVERSAMPLE_SHIFT - 1))) >> ADC_OVERSAMPLE_SHIFT;
+}
+
+
+/**
+    Work out the oscillator error at the filtered temperature from the
+    curve.
+
+    @return     The error in parts per million, positive when it runs fast.
+*/
+static int16_t getTemperatureCorrection()
+{
+    int16_t difference = getFilteredTemperature() - temperatureCurve.turnover * ADC_OVERSAMPLES;
+    if (difference > TEMPERATURE_DIFFERENCE_LIMIT)
+    {
+        difference = TEMPERATURE_DIFFERENCE_LIMIT;
+    }
+    else if (difference < -TEMPERATURE_DIFFERENCE_LIMIT)
+    {
+        difference = -TEMPERATURE_DIFFERENCE_LIMIT;
+    }
+
+    // The difference is in sixteenths of a degree, so both terms come out
+    // in 1/65536 ppm, and are rounded to whole ppm.
+    int32_t correction = (int32_t) temperatureCurve.linear * difference * 256
+        + (int32_t) temperatureCurve.quadratic * ((int32_t) difference * difference);
+    correction = (correction + 0x8000) >> 16;
+
+    if (correction > TEMPERATURE_CORRECTION_LIMIT)
+    {
+        return TEMPERATURE_CORRECTION_LIMIT;
+    }
+    else if (correction < -TEMPERATURE_CORRECTION_LIMIT)
+    {
+        return -TEMPERATURE_CORRECTION_LIMIT;
+    }
+    return correction;
+}
+
+
+void sampleTemperature()
+{
+    if (isTemperatureFiltered)
+    {
+        setClockCompensation(getTemperatureCorrection());
+    }
+
+    startAdcBurst(TEMPERATURE_ADC_MUX, filterTemperature);
+}
+
+#endif
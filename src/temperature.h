@@ -0,0 +1,72 @@
+/**
+    Temperature compensation.
+*/
+
+#include <stdint.h>
+
+
+/**
+    Temperature sensor input.
+
+    The chip's own sensor, ADC8, measured against the internal 1.1 V
+    reference. It reads about one ADC count per degree, and typically 300
+    at 25 C, but its offset varies by several degrees from chip to chip, so
+    the curve below is best fitted against the sensor's own readings.
+*/
+#define TEMPERATURE_ADC_MUX     ((1 << REFS1) | (1 << MUX5) | (1 << MUX1))
+#define TEMPERATURE_ADC_OFFSET  275             // ADC counts at 0 C
+
+
+/**
+    Oscillator temperature curve.
+
+    The oscillator error, in parts per million and positive when it runs
+    fast, is modelled as a parabola about a turnover temperature:
+
+        error = linear / 16 * (t - turnover) + quadratic / 256 * (t - turnover)^2
+
+    A crystal's curve is mostly the quadratic term, which is negative, so
+    it runs slow either side of the turnover. The error is added to the
+    oscillator trim, and limited to TEMPERATURE_CORRECTION_LIMIT.
+*/
+#define TEMPERATURE_CORRECTION_LIMIT    500
+
+
+/**
+    Apply the temperature curve saved in EEPROM.
+
+    Erased EEPROM reads as a flat curve, which leaves the clock alone.
+*/
+void loadTemperatureCurve();
+
+
+/**
+    Set the temperature curve, and save it to EEPROM. Blocks while the
+    EEPROM is written.
+
+    @param turnover     Turnover temperature, in degrees C.
+    @param linear       Linear coefficient, in 1/16 ppm per degree C.
+    @param quadratic    Quadratic coefficient, in 1/256 ppm per degree C
+                        squared.
+*/
+void setTemperatureCurve(int8_t turnover, int8_t linear, int8_t quadratic);
+
+
+/**
+    Start a burst of temperature sensor conversions, which completes in the
+    background from the ADC interrupt, and correct the clock for the last
+    temperature read.
+
+    Scheduled from the system tick as a background task, since working out
+    the correction takes a few multiplies. Needs setupAdc() to have been
+    called.
+*/
+void sampleTemperature();
+
+
+/**
+    Get the filtered temperature.
+
+    @return     Degrees C, rounded, or 0 until the sensor has been read.
+*/
+int8_t getTemperature();
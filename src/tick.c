@@ -0,0 +1,145 @@
+
+#include "hal.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "tick.h"
+
+
+#if TICK_TIMER_COUNT < 2 || TICK_TIMER_COUNT >= 0xff
+#error "TICK_RATE_HZ is out of range for Timer1 at this F_CPU"
+#endif
+
+#if F_CPU % TICK_TIMER_PRESCALE != 0
+#error "F_CPU must divide by TICK_TIMER_PRESCALE exactly to keep exact seconds"
+#endif
+
+
+/**
+    The Timer1 count at which the current tick began.
+*/
+volatile static uint16_t tickStartCount = 0;
+
+
+uint16_t getTickStartCount()
+{
+    return tickStartCount;
+}
+
+
+/**
+    Spread the remainder of the Timer1 counts in a second over its ticks.
+
+    The accumulator gains TICK_TIMER_REMAINDER each tick and carries a count
+    each time it passes TICK_RATE_HZ, so any TICK_RATE_HZ ticks in a row
+    carry exactly TICK_TIMER_REMAINDER counts between them.
+
+    @return     The extra Timer1 counts for this tick, 0 or 1.
+*/
+static inline uint8_t spreadTickRemainder()
+{
+#if TICK_TIMER_REMAINDER != 0
+    static uint16_t tickRemainder = 0;
+
+    tickRemainder += TICK_TIMER_REMAINDER;
+    if (tickRemainder >= TICK_RATE_HZ)
+    {
+        tickRemainder -= TICK_RATE_HZ;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+
+/**
+    Timer1 runs freely, and each tick schedules the next by advancing the
+    compare register by one period. Periods can then change length from
+    one tick to the next, to spread the remainder and apply the oscillator
+    trim, without the counter ever being past the new compare value, which
+    would make it miss the match and wrap.
+
+    Moving the tick to Timer1 freed Timer0 for hardware brightness PWM, but
+    the serial port now uses it instead, in CTC mode as its bit timer, so
+    brightness is still set by blanking from Timer1 compare B.
+*/
+void setupSystemTick()
+{
+    TCCR1B |= TICK_TIMER_CLOCK_SELECT;        // Divide the Timer1 clock by TICK_TIMER_PRESCALE
+    uint16_t count = TCNT1;
+    OCR1A = count + TICK_TIMER_COUNT;
+    OCR1B = count - 1;                        // Leave compare B until the display refresh sets it
+    TIMSK1 |= (1 << OCIE1A) | (1 << OCIE1B);  // Enable the tick and display blanking interrupts
+}
+
+
+/**
+    Interrupt latency budget.
+
+    The serial port samples each received bit a quarter of the way in, and
+    a sample that is held off past the end of its bit reads the next one.
+    Allowing 1% baud error at each end, the last sample of a byte has
+    about 0.56 of a bit to spare: around 460 cycles at 1200 baud and 1 MHz,
+    or 930 at 4800 baud and 8 MHz. The pin change interrupt that starts
+    the byte, and the Timer0 interrupt that takes the sample, can each be
+    held off, and both count against it.
+
+    The tick takes an estimated 800 to 1000 cycles with a bit-banged 16 bit
+    chain, most of it shifting out the next digit, and the blanking
+    interrupt that shifts in behind it around 450, so neither can hold off
+    the serial port for its whole run. Both open a serial window for their
+    work, leaving only their entry, under 100 cycles each, and the ADC
+    interrupt ending a burst, an estimated 250 cycles with the light
+    filter, which stays within the budget at both rates.
+
+    The Timer1 and ADC interrupts stay masked in the window: a tick during
+    a shift would latch a half shifted word, a tick during the tasks would
+    run them again before they finish, and keeping to one nested handler
+    bounds the stack. A blank count that passes meanwhile is served once
+    the tick returns, as before.
+
+    The profiled tick and blanking times include any serial interrupts
+    taken meanwhile.
+*/
+#ifdef SERIAL_PORT
+static uint8_t windowTimerMask;
+static uint8_t windowAdcMask;
+
+
+void openSerialWindow()
+{
+    windowTimerMask = TIMSK1;
+    windowAdcMask = ADCSRA & (1 << ADIE);
+    TIMSK1 = 0;
+
+    // ADIF is cleared by writing a one, so is written as zero to keep a
+    // pending conversion.
+    ADCSRA &= ~((1 << ADIE) | (1 << ADIF));
+    sei();
+}
+
+
+void closeSerialWindow()
+{
+    cli();
+    ADCSRA = (ADCSRA & ~(1 << ADIF)) | windowAdcMask;
+    TIMSK1 = windowTimerMask;
+}
+#endif
+
+
+ISR (TIM1_COMPA_vect)
+{
+    PROFILE_BEGIN(PROFILE_TICK);
+
+    tickStartCount = OCR1A;
+    OCR1A += TICK_TIMER_COUNT + spreadTickRemainder() + countClockTick();
+
+    // The display refresh is the first task, so that digits are drawn at
+    // a steady point in each tick.
+    openSerialWindow();
+    runTickTasks();
+    closeSerialWindow();
+
+    PROFILE_END(PROFILE_TICK);
+}
@@ -0,0 +1,84 @@
+/**
+    System tick.
+*/
+
+#include <stdint.h>
+
+#include "display.h"
+
+
+/**
+    System tick timing.
+
+    Timer1 interrupts TICK_RATE_HZ times a second. This is the only
+    timebase. Each tick refreshes one display digit, so the tick rate is
+    set by the display, 500 Hz for 4 digits, and the clock counts
+    TICK_RATE_HZ ticks to a second.
+*/
+#define TICK_RATE_HZ            (DISPLAY_REFRESH_HZ * DISPLAY_DIGITS)
+
+/**
+    Timer1 runs from the smallest prescaler that fits a tick in 8 bits, so
+    that offsets within a tick fit in a byte. At both 1 MHz and 8 MHz this
+    gives a 125 kHz Timer1 clock and 250 counts per tick for 4 digits.
+
+    Where the tick rate doesn't divide the Timer1 clock, as for 6 digits,
+    the remainder is spread over the second one count at a time, so some
+    ticks are TICK_TIMER_COUNT + 1 counts long and seconds stay exact.
+*/
+#if F_CPU / 8 / TICK_RATE_HZ < 0xff
+#define TICK_TIMER_PRESCALE     8
+#define TICK_TIMER_CLOCK_SELECT (1 << CS11)
+#elif F_CPU / 64 / TICK_RATE_HZ < 0xff
+#define TICK_TIMER_PRESCALE     64
+#define TICK_TIMER_CLOCK_SELECT ((1 << CS11) | (1 << CS10))
+#else
+#define TICK_TIMER_PRESCALE     256
+#define TICK_TIMER_CLOCK_SELECT (1 << CS12)
+#endif
+
+#define TICK_TIMER_COUNT        (F_CPU / TICK_TIMER_PRESCALE / TICK_RATE_HZ)
+#define TICK_TIMER_REMAINDER    (F_CPU / TICK_TIMER_PRESCALE % TICK_RATE_HZ)
+
+
+/**
+    Setup the system tick timer.
+*/
+void setupSystemTick();
+
+
+/**
+    Get the Timer1 count at which the current tick began.
+
+    Compare values for events within the tick, such as blanking the
+    display, are offsets from this count.
+*/
+uint16_t getTickStartCount();
+
+
+/**
+    Let only the serial port's interrupts in, from a Timer1 interrupt
+    handler with a long run of work ahead.
+
+    Masks the Timer1 and ADC interrupts, then enables interrupts, so that
+    the serial port's interrupts can be taken meanwhile, and no more than
+    one of them is ever nested. Must be followed by closeSerialWindow()
+    before the handler returns. Builds without SERIAL_PORT have nothing to
+    let in, so leave interrupts disabled.
+*/
+#ifdef SERIAL_PORT
+void openSerialWindow();
+#else
+#define openSerialWindow()
+#endif
+
+
+/**
+    Disable interrupts again, and restore the masks saved by
+    openSerialWindow().
+*/
+#ifdef SERIAL_PORT
+void closeSerialWindow();
+#else
+#define closeSerialWindow()
+#endif
@@ -0,0 +1,125 @@
+
+#include "hal.h"
+#include "clock.h"
+#include "display.h"
+#include "timeset.h"
+
+
+/**
+    Time set acceleration.
+
+    A press steps the clock forward one minute straight away. While the
+    button is held, steps repeat, growing larger the longer it is held.
+    Larger steps round the time down to a whole number of steps, so that
+    holding lands on ten minutes or on the hour.
+
+    Each stage lasts until the button has been held for its duration, in
+    samples. With these stages any time of day is reached within about
+    seven seconds.
+*/
+typedef struct
+{
+    uint16_t heldUntil;
+    uint8_t interval;
+    uint8_t stepMinutes;
+} TimeSetStage;
+
+static const TimeSetStage timeSetStages[] PROGMEM = {
+    { 50,       50, 1  },   // the press, then wait half a second
+    { 150,      10, 1  },   // 10 minutes a second for a second
+    { 300,      15, 10 },   // 10 minute steps for a second and a half
+    { 0xffff,   15, 60 },   // hours, at 6.7 hours a second
+};
+
+#define TIME_SET_STAGE_COUNT    (sizeof(timeSetStages) / sizeof(timeSetStages[0]))
+
+
+typedef enum
+{
+    TIME_SET_RELEASED,
+    TIME_SET_HELD,
+} TimeSetState;
+
+volatile static TimeSetState timeSetState = TIME_SET_RELEASED;
+volatile static bool isTimeSetSuspended = false;
+
+
+void setTimeSetSuspended(bool isSuspended)
+{
+    isTimeSetSuspended = isSuspended;
+}
+
+
+bool isTimeSetActive()
+{
+    return timeSetState == TIME_SET_HELD;
+}
+
+
+/**
+    Step the clock forward to the next multiple of a step.
+*/
+static void stepClock(uint8_t stepMinutes)
+{
+    uint8_t minuteOfHour = getClockMinutes();
+    if (stepMinutes == 60)
+    {
+        advanceClockTime(60 - minuteOfHour);
+    }
+    else
+    {
+        advanceClockTime(stepMinutes - (minuteOfHour % stepMinutes));
+    }
+}
+
+
+void updateTimeSet()
+{
+    static uint16_t heldSamples = 0;
+    static uint8_t stage = 0;
+    static uint8_t intervalCount = 0;
+
+    if (isTimeSetSuspended)
+    {
+        takeInputPresses();
+        timeSetState = TIME_SET_RELEASED;
+        return;
+    }
+
+    if (takeInputPresses() & INPUT_SPEED_BUTTON)
+    {
+        timeSetState = TIME_SET_HELD;
+        heldSamples = 0;
+        stage = 0;
+        intervalCount = 0;
+
+        // Stop the power failure blink once the clock has been set.
+        setDisplayBlink(false);
+    }
+    else if ( ! isSpeedButtonPressed())
+    {
+        timeSetState = TIME_SET_RELEASED;
+    }
+
+    if (timeSetState != TIME_SET_HELD)
+    {
+        return;
+    }
+
+    if (heldSamples >= pgm_read_word(&timeSetStages[stage].heldUntil) && stage < TIME_SET_STAGE_COUNT - 1)
+    {
+        stage++;
+    }
+
+    if (intervalCount == 0)
+    {
+        stepClock(pgm_read_byte(&timeSetStages[stage].stepMinutes));
+        intervalCount = pgm_read_byte(&timeSetStages[stage].interval);
+    }
+
+    intervalCount--;
+    if (heldSamples < 0xffff)
+    {
+        heldSamples++;
+    }
+}
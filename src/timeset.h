@@ -0,0 +1,41 @@
+/**
+    Setting the time with the speed button.
+*/
+
+#include <stdbool.h>
+
+#include "io.h"
+
+
+/**
+    Rate at which updateTimeSet() is called, after each input sample.
+*/
+#define TIME_SET_RATE_HZ    INPUT_SAMPLE_RATE_HZ
+
+
+/**
+    Step the clock while the speed button is held.
+
+    Scheduled from the system tick at TIME_SET_RATE_HZ, after the inputs
+    are sampled.
+*/
+void updateTimeSet();
+
+
+/**
+    Stop or restart setting the time with the speed button.
+
+    While suspended, presses of the speed button are dropped rather than
+    stepping the clock, so that the calibration screen can use the button.
+
+    @param isSuspended  True to suspend setting the time.
+*/
+void setTimeSetSuspended(bool isSuspended);
+
+
+/**
+    Check if the time is being set.
+
+    @return     True from a press of the speed button until its release.
+*/
+bool isTimeSetActive();